@@ -8,6 +8,12 @@
 
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "commands.h"
+#include "inbox.h"
+#include "metrics.h"
+#include "resident.h"
+#include "trace.h"
+#include "workers.h"
 
 //==============================================================================
 class NewProjectApplication  : public juce::JUCEApplication
@@ -24,16 +30,76 @@ public:
     void initialise (const juce::String& commandLine) override
     {
         // This method is where you should put your application's initialisation code..
-        juce::ignoreUnused(commandLine);
+        juce::ArgumentList args ("SM-Keygen", commandLine);
+        const auto metricsPath = args.getValueForOption ("--metrics-json");
+        if (metricsPath.isNotEmpty())
+            metricsDumpFile = juce::File::getCurrentWorkingDirectory().getChildFile (metricsPath);
+
+        const auto tracePath = args.getValueForOption ("--trace-json");
+        if (tracePath.isNotEmpty())
+            traceDumpFile = juce::File::getCurrentWorkingDirectory().getChildFile (tracePath);
+
+        trace::setThreadName ("message thread");
+
+        const auto params = getCommandLineParameterArray();
+        if (commands::isHeadless (params))
+        {
+            // Hand the command to a warm instance if one is running, otherwise
+            // do the work here without ever creating a window.
+            const auto cwd = juce::File::getCurrentWorkingDirectory();
+            commands::Result result;
+            if (params.contains ("--local") || ! resident::forward (params, cwd, result))
+                result = commands::run (params, cwd);
+
+            commands::printResult (result);
+            setApplicationReturnValue (result.exitCode);
+            quit();
+            return;
+        }
 
-        mainWindow.reset (new MainWindow (getApplicationName()));
+        if (const int watchIndex = params.indexOf ("--watch"); watchIndex >= 0)
+        {
+            if (params.size() >= watchIndex + 3)
+            {
+                const auto cwd = juce::File::getCurrentWorkingDirectory();
+                inboxWatcher = std::make_unique<inbox::Watcher> (cwd.getChildFile (params[watchIndex + 1].unquoted()),
+                                                                 cwd.getChildFile (params[watchIndex + 2].unquoted()));
+                if (! inboxWatcher->start())
+                    inboxWatcher = nullptr;
+            }
+
+            if (inboxWatcher == nullptr)
+            {
+                commands::printResult ({ 1, "usage: --watch <inbox-dir> <outbox-dir>" });
+                setApplicationReturnValue (1);
+                quit();
+            }
+            return;
+        }
+
+        // Only the first instance gets the port; later GUI instances just run normally.
+        residentServer = std::make_unique<resident::Server>();
+        if (! residentServer->start())
+            residentServer = nullptr;
+
+        if (! params.contains ("--resident"))
+            mainWindow.reset (new MainWindow (getApplicationName()));
     }
 
     void shutdown() override
     {
         // Add your application's shutdown code here..
 
+        residentServer = nullptr;
+        inboxWatcher = nullptr;
         mainWindow = nullptr; // (deletes our window)
+        workers::shutdown();
+
+        if (metricsDumpFile != juce::File{})
+            metricsDumpFile.replaceWithText (metrics::toJson (metrics::snapshot()) + "\n");
+
+        if (traceDumpFile != juce::File{})
+            trace::writeChromeJson (traceDumpFile.getFullPathName().toStdString());
     }
 
     //==============================================================================
@@ -46,9 +112,9 @@ public:
 
     void anotherInstanceStarted (const juce::String& commandLine) override
     {
-        // When another instance of the app is launched while this one is running,
-        // this method is invoked, and the commandLine parameter tells you what
-        // the other instance's command-line arguments were.
+        // Never called while moreThanOneInstanceAllowed() is true: a second
+        // launch needs its own process to print the result, so commands are
+        // forwarded through resident::Server instead.
         juce::ignoreUnused(commandLine);
     }
 
@@ -100,6 +166,10 @@ public:
 
 private:
     std::unique_ptr<MainWindow> mainWindow;
+    std::unique_ptr<resident::Server> residentServer;
+    std::unique_ptr<inbox::Watcher> inboxWatcher;
+    juce::File metricsDumpFile;
+    juce::File traceDumpFile;
 };
 
 //==============================================================================
@@ -1,5 +1,10 @@
 #include "MainComponent.h"
+#include "batch.h"
 #include "license.h"
+#include "sinks.h"
+#include "tasks.h"
+#include "trace.h"
+#include "verify_cache.h"
 #include <juce_gui_basics/juce_gui_basics.h>
 
 namespace
@@ -9,16 +14,18 @@ namespace
     juce::Colour invalidColour() { return juce::Colours::red; }
     juce::Colour errorColour() { return juce::Colours::orange; }
 
-    juce::String escapeCsvField(const juce::String& input)
-    {
-        auto escaped = input;
-        const bool needsQuotes = escaped.containsAnyOf(",\"\n\r");
-        escaped = escaped.replace("\"", "\"\"");
-
-        if (needsQuotes)
-            return '"' + escaped + '"';
+    constexpr int metricsPanelHeight = 190;
+    constexpr int searchPanelHeight = 260;
 
-        return escaped;
+    juce::String formatNanos(uint64_t nanos)
+    {
+        if (nanos >= 1000000000ull)
+            return juce::String(static_cast<double>(nanos) / 1.0e9, 2) + " s";
+        if (nanos >= 1000000ull)
+            return juce::String(static_cast<double>(nanos) / 1.0e6, 2) + " ms";
+        if (nanos >= 1000ull)
+            return juce::String(static_cast<double>(nanos) / 1.0e3, 1) + " us";
+        return juce::String(static_cast<juce::int64>(nanos)) + " ns";
     }
 
     bool isNeutralStatusColour(juce::Colour colour)
@@ -57,10 +64,34 @@ MainComponent::MainComponent()
     statusLabel.setColour(juce::Label::outlineColourId, juce::Colours::transparentBlack);
     statusLabel.setText("Ready", juce::dontSendNotification);
 
-    setSize (720, 420);
+    addChildComponent(metricsView);
+    metricsView.setReadOnly(true);
+    metricsView.setMultiLine(true);
+    metricsView.setCaretVisible(false);
+    metricsView.setFont(juce::Font(juce::FontOptions(juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain)));
+
+    addChildComponent(searchPanel);
+
+    stallWatchdog = std::make_unique<watchdog::Watchdog>(batch::defaultLedgerFile().getSiblingFile("stalls.log"));
+    stallWatchdog->onStall = [this](const watchdog::Stall& stall)
+    {
+        updateStatus("UI blocked for " + juce::String(juce::roundToInt(stall.milliseconds)) + " ms in "
+                         + stall.operation + " (see stalls.log)",
+                     errorColour());
+    };
+
+    setSize (820, 420);
 }
 
-MainComponent::~MainComponent() = default;
+MainComponent::~MainComponent()
+{
+    stopTimer();
+    stallWatchdog = nullptr;
+
+    // Give queued ledger appends a bounded chance to start; once one is
+    // running, workers::shutdown() joins it and it finishes the queue.
+    ledgerAppends.waitUntilIdle(2000);
+}
 
 void MainComponent::setupEditors()
 {
@@ -85,17 +116,24 @@ void MainComponent::setupEditors()
 
 void MainComponent::setupButtons()
 {
-    auto configure = [this](juce::TextButton& btn, auto&& handler)
+    // Every click is tagged, so a stall report names the button behind it.
+    auto configure = [this](juce::TextButton& btn, const char* operation, auto&& handler)
     {
         addAndMakeVisible(btn);
-        btn.onClick = handler;
+        btn.onClick = [operation, handler]
+        {
+            const watchdog::ScopedOperation op(operation);
+            handler();
+        };
     };
 
-    configure(btnGenerate, [this]() { generateLicense(); });
-    configure(btnVerify, [this]() { verifyCurrentLicense(); });
-    configure(btnCopy, [this]() { copyLicenseToClipboard(); });
-    configure(btnBatchIn, [this]() { loadBatchFromCsv(); });
-    configure(btnSaveCsv, [this]() { saveBatchToCsv(); });
+    configure(btnGenerate, "generate", [this]() { generateLicense(); });
+    configure(btnVerify, "verify", [this]() { verifyCurrentLicense(); });
+    configure(btnCopy, "copy", [this]() { copyLicenseToClipboard(); });
+    configure(btnBatchIn, "CSV load", [this]() { loadBatchFromCsv(); });
+    configure(btnSaveCsv, "save", [this]() { saveBatchToCsv(); });
+    configure(btnMetrics, "metrics panel", [this]() { toggleMetricsPanel(); });
+    configure(btnSearch, "search panel", [this]() { toggleSearchPanel(); });
 
     btnCopy.setEnabled(false);
 }
@@ -125,7 +163,9 @@ void MainComponent::resized()
     buttonFlex.items.add(juce::FlexItem(btnVerify).withFlex(1.0f).withMinWidth(100.0f).withMargin(juce::FlexItem::Margin(0, 8, 0, 0)));
     buttonFlex.items.add(juce::FlexItem(btnCopy).withFlex(1.0f).withMinWidth(100.0f).withMargin(juce::FlexItem::Margin(0, 8, 0, 0)));
     buttonFlex.items.add(juce::FlexItem(btnBatchIn).withFlex(1.2f).withMinWidth(140.0f).withMargin(juce::FlexItem::Margin(0, 8, 0, 0)));
-    buttonFlex.items.add(juce::FlexItem(btnSaveCsv).withFlex(1.2f).withMinWidth(120.0f));
+    buttonFlex.items.add(juce::FlexItem(btnSaveCsv).withFlex(1.2f).withMinWidth(120.0f).withMargin(juce::FlexItem::Margin(0, 8, 0, 0)));
+    buttonFlex.items.add(juce::FlexItem(btnMetrics).withFlex(1.0f).withMinWidth(110.0f).withMargin(juce::FlexItem::Margin(0, 8, 0, 0)));
+    buttonFlex.items.add(juce::FlexItem(btnSearch).withFlex(1.0f).withMinWidth(110.0f));
     buttonFlex.performLayout(buttonRow);
 
     area.removeFromTop(12);
@@ -135,6 +175,18 @@ void MainComponent::resized()
     area.removeFromTop(12);
     auto statusArea = area.removeFromTop(24);
     statusLabel.setBounds(statusArea);
+
+    if (metricsVisible)
+    {
+        area.removeFromTop(12);
+        metricsView.setBounds(area.removeFromTop(metricsPanelHeight));
+    }
+
+    if (searchVisible)
+    {
+        area.removeFromTop(12);
+        searchPanel.setBounds(area.removeFromTop(searchPanelHeight));
+    }
 }
 
 void MainComponent::updateStatus(const juce::String& message, juce::Colour colour)
@@ -165,23 +217,118 @@ void MainComponent::updateCopyState()
     btnCopy.setEnabled(! keyOut.getText().isEmpty());
 }
 
+void MainComponent::toggleMetricsPanel()
+{
+    metricsVisible = ! metricsVisible;
+    metricsView.setVisible(metricsVisible);
+    btnMetrics.setButtonText(metricsVisible ? "Hide Metrics" : "Show Metrics");
+
+    const int delta = metricsPanelHeight + 12;
+    setSize(getWidth(), getHeight() + (metricsVisible ? delta : -delta));
+
+    if (metricsVisible)
+    {
+        const auto snap = metrics::snapshot();
+        lastMetricsRows = snap.rows;
+        lastMetricsUptime = snap.uptimeSeconds;
+        refreshMetrics();
+        startTimer(500);
+    }
+    else
+    {
+        stopTimer();
+    }
+}
+
+void MainComponent::toggleSearchPanel()
+{
+    searchVisible = ! searchVisible;
+    btnSearch.setButtonText(searchVisible ? "Hide Search" : "Search Ledger");
+
+    const int delta = searchPanelHeight + 12;
+    setSize(getWidth(), getHeight() + (searchVisible ? delta : -delta));
+    searchPanel.setVisible(searchVisible);
+}
+
+void MainComponent::timerCallback()
+{
+    const watchdog::ScopedOperation op("metrics refresh");
+    refreshMetrics();
+}
+
+void MainComponent::refreshMetrics()
+{
+    const auto snap = metrics::snapshot();
+    const double elapsed = snap.uptimeSeconds - lastMetricsUptime;
+    const double rowsPerSecond = elapsed > 0.0 ? static_cast<double>(snap.rows - lastMetricsRows) / elapsed : 0.0;
+    lastMetricsRows = snap.rows;
+    lastMetricsUptime = snap.uptimeSeconds;
+
+    juce::String text;
+    text << "Rows/s: " << juce::String(rowsPerSecond, 1)
+         << "   Total rows: " << juce::String(static_cast<juce::int64>(snap.rows))
+         << "   Memory: " << juce::File::descriptionOfSizeInBytes(static_cast<juce::int64>(snap.residentBytes))
+         << "   Verify cache: " << juce::String(static_cast<juce::int64>(snap.cacheHits)) << " hits / "
+         << juce::String(static_cast<juce::int64>(snap.cacheMisses)) << " misses"
+         << "   Queued: " << juce::String(static_cast<juce::int64>(snap.queuedInteractive)) << " interactive / "
+         << juce::String(static_cast<juce::int64>(snap.queuedBulk)) << " bulk\n\n";
+
+    text << juce::String("stage").paddedRight(' ', 18)
+         << juce::String("count").paddedLeft(' ', 10)
+         << juce::String("p50").paddedLeft(' ', 12)
+         << juce::String("p99").paddedLeft(' ', 12)
+         << juce::String("p999").paddedLeft(' ', 12) << "\n";
+
+    for (size_t s = 0; s < metrics::kNumStages; ++s)
+    {
+        const auto& st = snap.stages[s];
+        text << juce::String(metrics::stageName(static_cast<metrics::Stage>(s))).paddedRight(' ', 18)
+             << juce::String(static_cast<juce::int64>(st.count)).paddedLeft(' ', 10)
+             << formatNanos(st.p50Nanos).paddedLeft(' ', 12)
+             << formatNanos(st.p99Nanos).paddedLeft(' ', 12)
+             << formatNanos(st.p999Nanos).paddedLeft(' ', 12) << "\n";
+    }
+
+    metricsView.setText(text, juce::dontSendNotification);
+}
+
 void MainComponent::generateLicense()
 {
     juce::String first, last, email;
     if (!validateInputs(first, last, email))
         return;
 
-    const juce::String licenseKey = license::makeLicense(first.toStdString(),
-                                                        last.toStdString(),
-                                                        email.toStdString());
-    keyOut.setText(licenseKey, juce::dontSendNotification);
-    keyOut.selectAll();
-
-    const bool saved = appendLicenseRecord(first, last, email, licenseKey);
+    struct Generated
+    {
+        juce::String licenseKey;
+        bool saved = false;
+    };
 
-    updateCopyState();
-    updateStatus(saved ? "Generated." : "Generated, but failed to update CSV.",
-                 saved ? defaultStatusColour() : errorColour());
+    updateStatus("Generating...", defaultStatusColour());
+
+    tasks::run(*this,
+               [first, last, email]
+               {
+                   Generated g;
+                   g.licenseKey = license::makeLicense(first.toStdString(),
+                                                       last.toStdString(),
+                                                       email.toStdString());
+                   metrics::addRows(1);
+                   g.saved = batch::appendLicenseRecord(batch::defaultLedgerFile(), first, last, email, g.licenseKey);
+                   return g;
+               },
+               [this](Generated g)
+               {
+                   const watchdog::ScopedOperation op("generate");
+                   keyOut.setText(g.licenseKey, juce::dontSendNotification);
+                   keyOut.selectAll();
+
+                   updateCopyState();
+                   updateStatus(g.saved ? "Generated." : "Generated, but failed to update CSV.",
+                                g.saved ? defaultStatusColour() : errorColour());
+                   searchPanel.refresh();
+               },
+               ledgerAppends);
 }
 
 void MainComponent::verifyCurrentLicense()
@@ -197,11 +344,18 @@ void MainComponent::verifyCurrentLicense()
         return;
     }
 
-    const bool valid = license::verifyLicense(licenseText.toStdString(),
-                                              first.toStdString(),
-                                              last.toStdString(),
-                                              email.toStdString());
-    updateStatus(valid ? "Valid" : "Invalid", valid ? validColour() : invalidColour());
+    tasks::run(*this,
+               [licenseText, first, last, email]
+               {
+                   return license::verifyLicenseCached(licenseText.toStdString(),
+                                                       first.toStdString(),
+                                                       last.toStdString(),
+                                                       email.toStdString());
+               },
+               [this](bool valid)
+               {
+                   updateStatus(valid ? "Valid" : "Invalid", valid ? validColour() : invalidColour());
+               });
 }
 
 void MainComponent::copyLicenseToClipboard()
@@ -214,35 +368,6 @@ void MainComponent::copyLicenseToClipboard()
     updateStatus("Copied to clipboard.", defaultStatusColour());
 }
 
-bool MainComponent::appendLicenseRecord(const juce::String& first,
-                                        const juce::String& last,
-                                        const juce::String& email,
-                                        const juce::String& licenseKey)
-{
-    auto csvFile = juce::File::getCurrentWorkingDirectory().getChildFile("Slot-Machine-Keys.csv");
-    const auto existingSize = csvFile.existsAsFile() ? csvFile.getSize() : 0;
-
-    juce::String textToAppend;
-
-    if (existingSize == 0)
-        textToAppend << "First,Last,Email,GeneratedAt,License\n";
-
-    const auto timestamp = juce::Time::getCurrentTime().toISO8601(true);
-    juce::StringArray fields { first, last, email, timestamp, licenseKey };
-
-    for (int i = 0; i < fields.size(); ++i)
-    {
-        if (i != 0)
-            textToAppend << ',';
-
-        textToAppend << escapeCsvField(fields[i]);
-    }
-
-    textToAppend << '\n';
-
-    return csvFile.appendText(textToAppend, false, false);
-}
-
 void MainComponent::loadBatchFromCsv()
 {
     openFileChooser = std::make_unique<juce::FileChooser>("Select CSV file to open", juce::File{}, "*.csv");
@@ -251,119 +376,102 @@ void MainComponent::loadBatchFromCsv()
         chooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
                              [this](const juce::FileChooser& fc)
                              {
-                                 auto file = fc.getResult();
-                                 if (file.existsAsFile())
-                                 {
-                                     juce::FileInputStream stream(file);
-                                     if (! stream.openedOk())
-                                     {
-                                         updateStatus("Failed to open file.", errorColour());
-                                         openFileChooser.reset();
-                                         return;
-                                     }
-
-                                     const juce::String content = stream.readEntireStreamAsString();
-                                     juce::StringArray lines;
-                                     lines.addLines(content);
-
-                                     if (lines.isEmpty())
-                                     {
-                                         updateStatus("CSV is empty.", errorColour());
-                                         openFileChooser.reset();
-                                         return;
-                                     }
-
-                                     auto looksLikeHeader = [](const juce::StringArray& columns)
-                                     {
-                                         if (columns.size() < 3)
-                                             return false;
-                                         return columns[0].trim().equalsIgnoreCase("first") &&
-                                                columns[1].trim().equalsIgnoreCase("last") &&
-                                                columns[2].trim().equalsIgnoreCase("email");
-                                     };
-
-                                     batchRows.clear();
-                                     batchRows.reserve(static_cast<size_t>(lines.size()));
-
-                                     for (int i = 0; i < lines.size(); ++i)
-                                     {
-                                         auto columns = juce::StringArray::fromTokens(lines[i], ",", "");
-                                         for (int c = 0; c < columns.size(); ++c)
-                                             columns.set(c, columns[c].trim());
-
-                                         if (i == 0 && looksLikeHeader(columns))
-                                             continue;
-
-                                         if (columns.size() < 3)
-                                             continue;
-
-                                         if (columns[0].isEmpty() || columns[1].isEmpty() || columns[2].isEmpty())
-                                             continue;
-
-                                         Row row;
-                                         row.first = columns[0];
-                                         row.last = columns[1];
-                                         row.email = columns[2];
-                                         row.license = license::makeLicense(row.first.toStdString(),
-                                                                            row.last.toStdString(),
-                                                                            row.email.toStdString());
-                                         batchRows.push_back(row);
-                                     }
-
-                                     if (batchRows.empty())
-                                     {
-                                         updateStatus("No rows parsed.", errorColour());
-                                     }
-                                     else
-                                     {
-                                         updateStatus(juce::String(batchRows.size()) + " licenses generated.", defaultStatusColour());
-                                     }
-                                 }
-
+                                 const watchdog::ScopedOperation op("CSV load");
+                                 const auto file = fc.getResult();
                                  openFileChooser.reset();
+                                 if (! file.existsAsFile())
+                                     return;
+
+                                 struct Loaded
+                                 {
+                                     juce::String error;
+                                     std::shared_ptr<const std::vector<batch::Row>> rows;
+                                 };
+
+                                 btnBatchIn.setEnabled(false);
+                                 updateStatus("Loading " + file.getFileName() + "...", defaultStatusColour());
+
+                                 tasks::run(*this,
+                                            [file]
+                                            {
+                                                SMK_TRACE_SCOPE("loadBatchFromCsv");
+                                                Loaded loaded;
+                                                juce::FileInputStream stream(file);
+                                                if (! stream.openedOk())
+                                                {
+                                                    loaded.error = "Failed to open file.";
+                                                    return loaded;
+                                                }
+
+                                                const juce::String content = stream.readEntireStreamAsString();
+                                                if (content.trim().isEmpty())
+                                                {
+                                                    loaded.error = "CSV is empty.";
+                                                    return loaded;
+                                                }
+
+                                                loaded.rows = std::make_shared<const std::vector<batch::Row>>(batch::issueFromCsv(content));
+                                                if (loaded.rows->empty())
+                                                    loaded.error = "No rows parsed.";
+                                                return loaded;
+                                            },
+                                            [this](Loaded loaded)
+                                            {
+                                                const watchdog::ScopedOperation op("CSV load");
+                                                btnBatchIn.setEnabled(true);
+
+                                                if (loaded.error.isNotEmpty())
+                                                {
+                                                    updateStatus(loaded.error, errorColour());
+                                                    return;
+                                                }
+
+                                                batchRows = std::move(loaded.rows);
+                                                updateStatus(juce::String(batchRows->size()) + " licenses generated.", defaultStatusColour());
+                                            },
+                                            workers::Priority::bulk);
                              });
     }
 }
 
 void MainComponent::saveBatchToCsv()
 {
-    if (batchRows.empty())
+    if (batchRows == nullptr || batchRows->empty())
     {
         updateStatus("No batch data to save.", errorColour());
         return;
     }
 
-    saveFileChooser = std::make_unique<juce::FileChooser>("Select CSV file to save", juce::File{}, "*.csv");
+    saveFileChooser = std::make_unique<juce::FileChooser>("Select file to save", juce::File{}, "*.csv;*.jsonl;*.txt");
     if (auto* chooser = saveFileChooser.get())
     {
         chooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles,
                              [this](const juce::FileChooser& fc)
                              {
-                                 auto file = fc.getResult();
-                                 if (file != juce::File{})
-                                 {
-                                     juce::FileOutputStream stream(file);
-                                     if (! stream.openedOk())
-                                     {
-                                         updateStatus("Failed to save file.", errorColour());
-                                         saveFileChooser.reset();
-                                         return;
-                                     }
-
-                                     stream << "first,last,email,license\n";
-                                     for (const auto& row : batchRows)
-                                     {
-                                         stream << row.first << ','
-                                                << row.last << ','
-                                                << row.email << ','
-                                                << row.license << '\n';
-                                     }
-
-                                     stream.flush();
-                                     updateStatus("CSV saved.", defaultStatusColour());
-                                 }
-
+                                 const watchdog::ScopedOperation op("save");
+                                 const auto file = fc.getResult();
                                  saveFileChooser.reset();
+                                 if (file == juce::File{})
+                                     return;
+
+                                 btnSaveCsv.setEnabled(false);
+                                 updateStatus("Saving " + file.getFileName() + "...", defaultStatusColour());
+
+                                 tasks::run(*this,
+                                            [file, rows = batchRows]
+                                            {
+                                                SMK_TRACE_SCOPE("saveBatchToCsv");
+                                                return sinks::writeAll(file, *rows);
+                                            },
+                                            [this, file](const juce::Result& saved)
+                                            {
+                                                btnSaveCsv.setEnabled(true);
+                                                if (saved.wasOk())
+                                                    updateStatus(sinks::formatName(sinks::formatFor(file)) + " saved.", defaultStatusColour());
+                                                else
+                                                    updateStatus("Failed to save: " + saved.getErrorMessage(), errorColour());
+                                            },
+                                            workers::Priority::bulk);
                              });
     }
 }
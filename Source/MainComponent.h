@@ -1,11 +1,17 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "batch.h"
 #include "license.h"
+#include "metrics.h"
+#include "SearchPanel.h"
+#include "tasks.h"
+#include "watchdog.h"
 #include <memory>
 #include <vector>
 
-class MainComponent  : public juce::Component
+class MainComponent  : public juce::Component,
+                       private juce::Timer
 {
 public:
     MainComponent();
@@ -15,29 +21,21 @@ public:
     void resized() override;
 
 private:
-    struct Row
-    {
-        juce::String first;
-        juce::String last;
-        juce::String email;
-        juce::String license;
-    };
-
     void setupEditors();
     void setupButtons();
     void updateStatus(const juce::String& message, juce::Colour colour);
     bool validateInputs(juce::String& outFirst, juce::String& outLast, juce::String& outEmail);
     void updateCopyState();
+    void toggleMetricsPanel();
+    void toggleSearchPanel();
+    void refreshMetrics();
+    void timerCallback() override;
 
     void generateLicense();
     void verifyCurrentLicense();
     void copyLicenseToClipboard();
     void loadBatchFromCsv();
     void saveBatchToCsv();
-    bool appendLicenseRecord(const juce::String& first,
-                             const juce::String& last,
-                             const juce::String& email,
-                             const juce::String& licenseKey);
 
     juce::TextEditor firstEdit;
     juce::TextEditor lastEdit;
@@ -49,12 +47,28 @@ private:
     juce::TextButton btnCopy { "Copy Key" };
     juce::TextButton btnBatchIn { "Batch from CSV..." };
     juce::TextButton btnSaveCsv { "Save CSV..." };
+    juce::TextButton btnMetrics { "Show Metrics" };
+    juce::TextButton btnSearch { "Search Ledger" };
 
     juce::Label statusLabel;
+    juce::TextEditor metricsView;
+    bool metricsVisible = false;
+    uint64_t lastMetricsRows = 0;
+    double lastMetricsUptime = 0.0;
+
+    SearchPanel searchPanel;
+    bool searchVisible = false;
 
-    std::vector<Row> batchRows;
+    // Shared with background saves, so it is never copied or mutated in place.
+    std::shared_ptr<const std::vector<batch::Row>> batchRows;
+
+    // Ledger appends run one at a time on the shared workers, so they land in click order.
+    tasks::SerialQueue ledgerAppends;
     std::unique_ptr<juce::FileChooser> openFileChooser;
     std::unique_ptr<juce::FileChooser> saveFileChooser;
 
+    // Reports callbacks that hold the message thread for 50 ms or more.
+    std::unique_ptr<watchdog::Watchdog> stallWatchdog;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
 };
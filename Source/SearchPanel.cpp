@@ -0,0 +1,166 @@
+#include "SearchPanel.h"
+#include "batch.h"
+#include "tasks.h"
+#include "watchdog.h"
+
+namespace
+{
+    constexpr size_t maxResults = 1000;
+}
+
+SearchPanel::SearchPanel()
+{
+    addAndMakeVisible(searchEdit);
+    searchEdit.setMultiLine(false);
+    searchEdit.setTextToShowWhenEmpty("Search ledger by name, email or key fragment", juce::Colours::darkgrey);
+    searchEdit.onTextChange = [this]()
+    {
+        const watchdog::ScopedOperation op("search");
+        runQuery();
+    };
+
+    addAndMakeVisible(summaryLabel);
+    summaryLabel.setJustificationType(juce::Justification::centredRight);
+
+    addAndMakeVisible(resultsList);
+    resultsList.setRowHeight(22);
+}
+
+SearchPanel::~SearchPanel() = default;
+
+void SearchPanel::resized()
+{
+    auto area = getLocalBounds();
+    auto top = area.removeFromTop(28);
+    summaryLabel.setBounds(top.removeFromRight(180));
+    top.removeFromRight(8);
+    searchEdit.setBounds(top);
+
+    area.removeFromTop(8);
+    resultsList.setBounds(area);
+}
+
+void SearchPanel::visibilityChanged()
+{
+    if (isVisible() && index == nullptr)
+        loadIndex();
+
+    if (isVisible())
+        searchEdit.grabKeyboardFocus();
+}
+
+void SearchPanel::loadIndex()
+{
+    index = std::make_shared<search::LedgerIndex>(batch::defaultLedgerFile());
+    summaryLabel.setText("Indexing ledger...", juce::dontSendNotification);
+
+    tasks::run(*this,
+               [idx = index] { return idx->load(); },
+               [this](juce::Result result)
+               {
+                   indexReady = result.wasOk();
+                   if (! indexReady)
+                   {
+                       // Dropped so that showing the panel again retries.
+                       index = nullptr;
+                       summaryLabel.setText(result.getErrorMessage(), juce::dontSendNotification);
+                       return;
+                   }
+
+                   summaryLabel.setText(juce::String(static_cast<juce::int64>(index->size())) + " records",
+                                        juce::dontSendNotification);
+                   runQuery();
+               },
+               workers::Priority::bulk);
+}
+
+void SearchPanel::refresh()
+{
+    if (indexReady)
+        runQuery();
+}
+
+void SearchPanel::runQuery()
+{
+    if (! indexReady)
+        return;
+
+    const auto text = searchEdit.getText().trim();
+    const auto generation = ++queryGeneration;
+
+    if (text.isEmpty())
+    {
+        results.clear();
+        resultsList.updateContent();
+        resultsList.repaint();
+        summaryLabel.setText(juce::String(static_cast<juce::int64>(index->size())) + " records",
+                             juce::dontSendNotification);
+        return;
+    }
+
+    struct Found
+    {
+        std::vector<uint32_t> rows;
+        bool truncated = false;
+        double millis = 0.0;
+    };
+
+    tasks::run(*this,
+               [idx = index, text]
+               {
+                   Found found;
+                   const auto start = juce::Time::getMillisecondCounterHiRes();
+                   found.rows = idx->query(text, maxResults, found.truncated);
+                   found.millis = juce::Time::getMillisecondCounterHiRes() - start;
+                   return found;
+               },
+               [this, generation](Found found)
+               {
+                   // A later keystroke has already asked for something else.
+                   if (generation != queryGeneration)
+                       return;
+
+                   results = std::move(found.rows);
+                   resultsList.updateContent();
+                   resultsList.scrollToEnsureRowIsOnscreen(0);
+                   resultsList.repaint();
+
+                   juce::String summary;
+                   summary << static_cast<juce::int64>(results.size()) << (found.truncated ? "+" : "")
+                           << " matches, " << juce::String(found.millis, 1) << " ms";
+                   summaryLabel.setText(summary, juce::dontSendNotification);
+               });
+}
+
+int SearchPanel::getNumRows()
+{
+    return static_cast<int>(results.size());
+}
+
+void SearchPanel::paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (rowNumber < 0 || rowNumber >= getNumRows())
+        return;
+
+    if (rowIsSelected)
+        g.fillAll(juce::Colours::lightblue.withAlpha(0.4f));
+
+    const auto r = index->record(results[static_cast<size_t>(rowNumber)]);
+    auto area = juce::Rectangle<int>(0, 0, width, height).reduced(6, 0);
+
+    g.setColour(getLookAndFeel().findColour(juce::ListBox::textColourId));
+    g.setFont(juce::Font(juce::FontOptions(13.0f)));
+    g.drawText(r.first + " " + r.last, area.removeFromLeft(width / 4), juce::Justification::centredLeft, true);
+    g.drawText(r.email, area.removeFromLeft(width / 3), juce::Justification::centredLeft, true);
+    g.drawText(r.license, area.removeFromLeft(210), juce::Justification::centredLeft, true);
+    g.drawText(r.generatedAt.substring(0, 10), area, juce::Justification::centredRight, true);
+}
+
+void SearchPanel::listBoxItemDoubleClicked(int row, const juce::MouseEvent&)
+{
+    if (row < 0 || row >= getNumRows())
+        return;
+
+    juce::SystemClipboard::copyTextToClipboard(index->record(results[static_cast<size_t>(row)]).license);
+    summaryLabel.setText("Key copied.", juce::dontSendNotification);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "search.h"
+#include <memory>
+#include <vector>
+
+/*
+    Ledger search box with a virtualised result list. The index is built in
+    the background the first time the panel is shown; each keystroke runs a
+    query off the message thread and only the newest query's results are
+    kept. Double-clicking a row copies its license key.
+*/
+class SearchPanel  : public juce::Component,
+                     private juce::ListBoxModel
+{
+public:
+    SearchPanel();
+    ~SearchPanel() override;
+
+    void resized() override;
+    void visibilityChanged() override;
+
+    // Re-runs the current query, e.g. after a new key was issued.
+    void refresh();
+
+private:
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void listBoxItemDoubleClicked(int row, const juce::MouseEvent&) override;
+
+    void loadIndex();
+    void runQuery();
+
+    juce::TextEditor searchEdit;
+    juce::Label summaryLabel;
+    juce::ListBox resultsList { "Ledger matches", this };
+
+    std::shared_ptr<search::LedgerIndex> index;
+    bool indexReady = false;
+    std::vector<uint32_t> results;
+    uint64_t queryGeneration = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SearchPanel)
+};
@@ -0,0 +1,223 @@
+#include "batch.h"
+#include "license.h"
+#include "metrics.h"
+#include "trace.h"
+#include "workers.h"
+
+namespace batch
+{
+    namespace
+    {
+        juce::CriticalSection ledgerLock;
+        juce::Array<LedgerListener*> ledgerListeners;
+
+        bool looksLikeHeader(const juce::StringArray& columns)
+        {
+            if (columns.size() < 3)
+                return false;
+            return columns[0].trim().equalsIgnoreCase("first") &&
+                   columns[1].trim().equalsIgnoreCase("last") &&
+                   columns[2].trim().equalsIgnoreCase("email");
+        }
+    }
+
+    bool parseLine(const juce::String& line, bool isFirstLine, Row& out)
+    {
+        metrics::ScopedTimer timer(metrics::Stage::csvParse);
+
+        // Quote-aware, so "Smith, Jr." stays one field.
+        auto columns = splitCsvLine(line);
+        for (int c = 0; c < columns.size(); ++c)
+            columns.set(c, columns[c].trim());
+
+        if (isFirstLine && looksLikeHeader(columns))
+            return false;
+
+        if (columns.size() < 3)
+            return false;
+
+        if (columns[0].isEmpty() || columns[1].isEmpty() || columns[2].isEmpty())
+            return false;
+
+        out.first = columns[0];
+        out.last = columns[1];
+        out.email = columns[2];
+        out.license.clear();
+        return true;
+    }
+
+    void issue(Row& row, const std::string& yyyymmdd, license::Scheme scheme)
+    {
+        if (yyyymmdd.empty())
+            row.license = license::SigningKey::builtIn().makeLicense(row.first.toStdString(),
+                                                                     row.last.toStdString(),
+                                                                     row.email.toStdString(),
+                                                                     license::currentDate(), scheme);
+        else
+            row.license = license::IdentitySigner(row.first.toStdString(),
+                                                  row.last.toStdString(),
+                                                  row.email.toStdString(), { scheme }).makeLicense(yyyymmdd, scheme);
+        metrics::addRows(1);
+    }
+
+    std::vector<Row> issueFromCsv(const juce::String& content, bool startsAtFileBeginning, const std::string& yyyymmdd)
+    {
+        juce::StringArray lines;
+        lines.addLines(content);
+
+        std::vector<Row> rows;
+        rows.reserve(static_cast<size_t>(lines.size()));
+
+        for (int i = 0; i < lines.size(); ++i)
+        {
+            Row row;
+            if (parseLine(lines[i], startsAtFileBeginning && i == 0, row))
+                rows.push_back(std::move(row));
+        }
+
+        // Signing is the expensive part; it runs as time-sliced bulk work.
+        workers::parallelFor(rows.size(), [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                issue(rows[i], yyyymmdd);
+        });
+
+        return rows;
+    }
+
+    juce::String escapeCsvField(const juce::String& input)
+    {
+        auto escaped = input;
+        const bool needsQuotes = escaped.containsAnyOf(",\"\n\r");
+        escaped = escaped.replace("\"", "\"\"");
+
+        if (needsQuotes)
+            return '"' + escaped + '"';
+
+        return escaped;
+    }
+
+    juce::StringArray splitCsvLine(const juce::String& line)
+    {
+        juce::StringArray fields;
+        juce::String field;
+        bool inQuotes = false;
+
+        for (auto p = line.getCharPointer(); ! p.isEmpty();)
+        {
+            const auto c = p.getAndAdvance();
+
+            if (inQuotes)
+            {
+                if (c != '"')
+                    field += c;
+                else if (*p == '"')
+                    field += p.getAndAdvance();
+                else
+                    inQuotes = false;
+            }
+            else if (c == '"')
+            {
+                inQuotes = true;
+            }
+            else if (c == ',')
+            {
+                fields.add(field);
+                field.clear();
+            }
+            else
+            {
+                field += c;
+            }
+        }
+
+        fields.add(field);
+        return fields;
+    }
+
+    void writeRows(juce::OutputStream& stream, const std::vector<Row>& rows, bool withHeader)
+    {
+        if (withHeader)
+            stream << "first,last,email,license\n";
+
+        for (const auto& row : rows)
+        {
+            stream << escapeCsvField(row.first) << ','
+                   << escapeCsvField(row.last) << ','
+                   << escapeCsvField(row.email) << ','
+                   << escapeCsvField(row.license) << '\n';
+        }
+    }
+
+    bool appendCsv(const juce::File& file, const std::vector<Row>& rows)
+    {
+        SMK_TRACE_SCOPE("appendCsv");
+
+        const bool isNew = ! file.existsAsFile() || file.getSize() == 0;
+        juce::FileOutputStream stream(file);
+        if (! stream.openedOk())
+            return false;
+
+        writeRows(stream, rows, isNew);
+
+        stream.flush();
+        return stream.getStatus().wasOk();
+    }
+
+    juce::File defaultLedgerFile(const juce::File& directory)
+    {
+        return directory.getChildFile("Slot-Machine-Keys.csv");
+    }
+
+    bool appendLicenseRecord(const juce::File& ledger,
+                             const juce::String& first,
+                             const juce::String& last,
+                             const juce::String& email,
+                             const juce::String& licenseKey)
+    {
+        SMK_TRACE_SCOPE("appendLicenseRecord");
+        metrics::ScopedTimer timer(metrics::Stage::ledgerWrite);
+
+        const juce::ScopedLock lock(ledgerLock);
+        const auto existingSize = ledger.existsAsFile() ? ledger.getSize() : 0;
+
+        juce::String textToAppend;
+
+        if (existingSize == 0)
+            textToAppend << "First,Last,Email,GeneratedAt,License\n";
+
+        const auto timestamp = juce::Time::getCurrentTime().toISO8601(true);
+        juce::StringArray fields { first, last, email, timestamp, licenseKey };
+
+        for (int i = 0; i < fields.size(); ++i)
+        {
+            if (i != 0)
+                textToAppend << ',';
+
+            textToAppend << escapeCsvField(fields[i]);
+        }
+
+        textToAppend << '\n';
+
+        if (! ledger.appendText(textToAppend, false, false))
+            return false;
+
+        for (auto* listener : ledgerListeners)
+            listener->ledgerRecordAppended(ledger, fields);
+
+        return true;
+    }
+
+    juce::int64 addLedgerListener(LedgerListener* listener, const juce::File& ledger)
+    {
+        const juce::ScopedLock lock(ledgerLock);
+        ledgerListeners.addIfNotAlreadyThere(listener);
+        return ledger.existsAsFile() ? ledger.getSize() : 0;
+    }
+
+    void removeLedgerListener(LedgerListener* listener)
+    {
+        const juce::ScopedLock lock(ledgerLock);
+        ledgerListeners.removeFirstMatchingValue(listener);
+    }
+} // namespace batch
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "license.h"
+#include <string>
+#include <vector>
+
+/*
+    Batch issuance shared by the GUI, the headless command line and the
+    resident instance: parse an operator CSV (first,last,email[,...]),
+    sign every row and write the result or append it to the ledger.
+*/
+namespace batch
+{
+    struct Row
+    {
+        juce::String first;
+        juce::String last;
+        juce::String email;
+        juce::String license;
+    };
+
+    // Splits one input line into a row. Returns false for header lines
+    // (only recognised when isFirstLine is set) and for rows missing a field.
+    bool parseLine(const juce::String& line, bool isFirstLine, Row& out);
+
+    // Parses every line of content and signs the rows that survive. Set
+    // startsAtFileBeginning to false for a chunk from the middle of a file,
+    // so its first line is never mistaken for the header. Keys are dated
+    // today unless yyyymmdd is given.
+    std::vector<Row> issueFromCsv(const juce::String& content, bool startsAtFileBeginning = true,
+                                  const std::string& yyyymmdd = {});
+
+    void issue(Row& row, const std::string& yyyymmdd = {}, license::Scheme scheme = license::kIssueScheme);
+
+    juce::String escapeCsvField(const juce::String& input);
+
+    // Splits one CSV line into fields, honouring "quoted, fields" and the
+    // "" escape that escapeCsvField writes.
+    juce::StringArray splitCsvLine(const juce::String& line);
+
+    // Writes rows in the output CSV layout, optionally preceded by the header.
+    // Whole files are better written through sinks::writeAll.
+    void writeRows(juce::OutputStream& stream, const std::vector<Row>& rows, bool withHeader);
+
+    // Appends rows to file, writing the header first if the file is new.
+    bool appendCsv(const juce::File& file, const std::vector<Row>& rows);
+
+    // The ledger of every key handed out, kept in the working directory.
+    juce::File defaultLedgerFile(const juce::File& directory = juce::File::getCurrentWorkingDirectory());
+
+    // Appends one record to the ledger, writing the header first if the file
+    // is new. Safe to call from several threads.
+    bool appendLicenseRecord(const juce::File& ledger,
+                             const juce::String& first,
+                             const juce::String& last,
+                             const juce::String& email,
+                             const juce::String& licenseKey);
+
+    // Told about every record appendLicenseRecord writes (First, Last, Email,
+    // GeneratedAt, License), on the writing thread with the ledger lock held.
+    struct LedgerListener
+    {
+        virtual ~LedgerListener() = default;
+        virtual void ledgerRecordAppended(const juce::File& ledger, const juce::StringArray& fields) = 0;
+    };
+
+    // Returns the ledger's size at the moment of registering: every record
+    // past that offset reaches the listener, none before it does.
+    juce::int64 addLedgerListener(LedgerListener* listener, const juce::File& ledger);
+    void removeLedgerListener(LedgerListener* listener);
+} // namespace batch
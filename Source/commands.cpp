@@ -0,0 +1,180 @@
+#include "commands.h"
+#include "batch.h"
+#include "journal.h"
+#include "license.h"
+#include "loadtest.h"
+#include "reconcile.h"
+#include "renew.h"
+#include "replication.h"
+#include "shard.h"
+#include "sinks.h"
+#include "verify_cache.h"
+
+#include <cstdio>
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#endif
+
+namespace commands
+{
+    namespace
+    {
+        Result fail(const juce::String& message)
+        {
+            return { 1, message };
+        }
+
+        Result issueOne(const juce::StringArray& args, int index, const juce::File& cwd)
+        {
+            if (args.size() < index + 4)
+                return fail("usage: --issue <first> <last> <email> [--scheme=v1|v2]");
+
+            license::Scheme scheme;
+            if (! schemeOption(args, scheme))
+                return fail("--scheme must be v1 or v2");
+
+            batch::Row row;
+            row.first = args[index + 1].trim();
+            row.last = args[index + 2].trim();
+            row.email = args[index + 3].trim();
+            if (row.first.isEmpty() || row.last.isEmpty() || row.email.isEmpty())
+                return fail("first, last and email must not be empty");
+
+            batch::issue(row, {}, scheme);
+            if (row.license.isEmpty())
+                return fail("failed to generate license");
+
+            if (! batch::appendLicenseRecord(batch::defaultLedgerFile(cwd), row.first, row.last, row.email, row.license))
+                return { 2, row.license + "\nwarning: failed to update ledger" };
+
+            return { 0, row.license };
+        }
+
+        Result verifyOne(const juce::StringArray& args, int index)
+        {
+            if (args.size() < index + 5)
+                return fail("usage: --verify <license> <first> <last> <email>");
+
+            const bool valid = license::verifyLicenseCached(args[index + 1].trim().toStdString(),
+                                                            args[index + 2].trim().toStdString(),
+                                                            args[index + 3].trim().toStdString(),
+                                                            args[index + 4].trim().toStdString());
+            return { valid ? 0 : 1, valid ? "Valid" : "Invalid" };
+        }
+
+        Result runBatch(const juce::StringArray& args, int index, const juce::File& cwd)
+        {
+            if (args.size() < index + 3)
+                return fail("usage: --batch <in.csv> <out.csv>");
+
+            const auto input = cwd.getChildFile(args[index + 1]);
+            const auto output = cwd.getChildFile(args[index + 2]);
+
+            if (! input.existsAsFile())
+                return fail("input not found: " + input.getFullPathName());
+
+            // CSV output is streamed with checkpoints so a rerun resumes.
+            if (sinks::formatFor(output) == sinks::Format::csv)
+            {
+                journal::Summary summary;
+                if (const auto r = journal::run(input, output, summary); r.failed())
+                    return fail(r.getErrorMessage());
+                if (summary.rows == 0)
+                    return fail("no rows parsed");
+
+                juce::String text;
+                text << summary.rows << " licenses generated.";
+                if (summary.resumedAtRow >= 0)
+                    text << " (resumed after row " << summary.resumedAtRow << ")";
+                return { 0, text };
+            }
+
+            juce::FileInputStream stream(input);
+            if (! stream.openedOk())
+                return fail("failed to open " + input.getFullPathName());
+
+            const auto rows = batch::issueFromCsv(stream.readEntireStreamAsString());
+            if (rows.empty())
+                return fail("no rows parsed");
+
+            if (const auto r = sinks::writeAll(output, rows); r.failed())
+                return fail(r.getErrorMessage());
+
+            return { 0, juce::String(rows.size()) + " licenses generated." };
+        }
+    }
+
+    bool schemeOption(const juce::StringArray& args, license::Scheme& scheme)
+    {
+        scheme = license::kIssueScheme;
+        for (const auto& arg : args)
+            if (arg.startsWith("--scheme="))
+                return license::schemeFromName(arg.fromFirstOccurrenceOf("=", false, false).toStdString(), scheme);
+        return true;
+    }
+
+    bool isHeadless(const juce::StringArray& args)
+    {
+        return args.contains("--issue") || args.contains("--verify") || args.contains("--batch")
+            || shard::handles(args) || loadtest::handles(args) || renew::handles(args)
+            || replication::handles(args) || reconcile::handles(args);
+    }
+
+    Result run(const juce::StringArray& rawArgs, const juce::File& workingDirectory)
+    {
+        // On Windows the parameter array keeps the quotes around "Mary Ann".
+        juce::StringArray args;
+        for (const auto& arg : rawArgs)
+            args.add(arg.unquoted());
+
+        if (const int i = args.indexOf("--issue"); i >= 0)
+            return issueOne(args, i, workingDirectory);
+
+        if (const int i = args.indexOf("--verify"); i >= 0)
+            return verifyOne(args, i);
+
+        if (const int i = args.indexOf("--batch"); i >= 0)
+            return runBatch(args, i, workingDirectory);
+
+        if (shard::handles(args))
+            return shard::run(args, workingDirectory);
+
+        if (loadtest::handles(args))
+            return loadtest::run(args, workingDirectory);
+
+        if (renew::handles(args))
+            return renew::run(args, workingDirectory);
+
+        if (replication::handles(args))
+            return replication::run(args, workingDirectory);
+
+        if (reconcile::handles(args))
+            return reconcile::run(args, workingDirectory);
+
+        return fail("unknown command");
+    }
+
+    void printResult(const Result& result)
+    {
+       #if JUCE_WINDOWS
+        if (AttachConsole(ATTACH_PARENT_PROCESS))
+        {
+            FILE* ignored = nullptr;
+            freopen_s(&ignored, "CONOUT$", "w", stdout);
+            freopen_s(&ignored, "CONOUT$", "w", stderr);
+        }
+       #endif
+
+        if (result.output.isEmpty())
+            return;
+
+        FILE* out = result.exitCode == 0 ? stdout : stderr;
+        std::fputs(result.output.toRawUTF8(), out);
+        std::fputc('\n', out);
+        std::fflush(out);
+    }
+} // namespace commands
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "license.h"
+
+/*
+    Headless command-line operations. These run either in a fresh process or,
+    when a resident instance is up, inside that instance on behalf of a client
+    (see resident.h), so they take the caller's working directory explicitly.
+
+        --issue  <first> <last> <email> [--scheme=v1|v2]
+        --verify <license> <first> <last> <email>
+        --batch  <in.csv> <out.csv>   resumable for CSV output (see journal.h)
+        --shard* (see shard.h)
+        --gen-dataset, --loadtest (see loadtest.h)
+        --renew  <ledger.csv> <out> [--date=YYYYMMDD] [--scheme=v1|v2] (see renew.h)
+        --ledger-publish, --ledger-sync (see replication.h)
+        --reconcile <orders.csv> <ledger.csv> <out-dir> (see reconcile.h)
+
+    --local runs the command in this process even if a resident instance
+    is up. --scheme=v2 opts into V2 keys; the default is license::kIssueScheme.
+*/
+namespace commands
+{
+    struct Result
+    {
+        int exitCode = 0;
+        juce::String output;
+    };
+
+    // True if the arguments name a command that needs no window.
+    bool isHeadless(const juce::StringArray& args);
+
+    Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+
+    // Reads --scheme=v1|v2, defaulting to license::kIssueScheme. Returns
+    // false if the option names neither.
+    bool schemeOption(const juce::StringArray& args, license::Scheme& scheme);
+
+    // Writes output to stdout (or stderr on failure), attaching to the parent
+    // console first on Windows since the app is built for the GUI subsystem.
+    void printResult(const Result& result);
+} // namespace commands
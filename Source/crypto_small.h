@@ -162,57 +162,273 @@ namespace crypto_small
                 output[i * 4 + 3] = static_cast<uint8_t>((ctx.state[i]) & 0xffu);
             }
         }
+
+        // BLAKE2s (RFC 7693): 32-bit words, ten rounds, 64-byte blocks.
+        struct Blake2sState
+        {
+            uint32_t h[8];
+            uint32_t t[2] = { 0, 0 };
+            uint8_t buffer[64];
+            uint32_t bufferLength = 0;
+        };
+
+        constexpr uint32_t kBlake2sIv[8] =
+        {
+            0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au,
+            0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u
+        };
+
+        inline void blake2sCompress(Blake2sState& s, const uint8_t* block, bool last) noexcept
+        {
+            static const uint8_t sigma[10][16] =
+            {
+                { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+                { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+                { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+                { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+                { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+                { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+                { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+                { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+                { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+                { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 }
+            };
+
+            uint32_t m[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                m[i] = (static_cast<uint32_t>(block[i * 4])) |
+                       (static_cast<uint32_t>(block[i * 4 + 1]) << 8) |
+                       (static_cast<uint32_t>(block[i * 4 + 2]) << 16) |
+                       (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+            }
+
+            uint32_t v[16];
+            for (int i = 0; i < 8; ++i)
+            {
+                v[i] = s.h[i];
+                v[i + 8] = kBlake2sIv[i];
+            }
+            v[12] ^= s.t[0];
+            v[13] ^= s.t[1];
+            if (last)
+                v[14] = ~v[14];
+
+            auto g = [&v](int a, int b, int c, int d, uint32_t x, uint32_t y) noexcept
+            {
+                v[a] = v[a] + v[b] + x;
+                v[d] = rotr(v[d] ^ v[a], 16);
+                v[c] = v[c] + v[d];
+                v[b] = rotr(v[b] ^ v[c], 12);
+                v[a] = v[a] + v[b] + y;
+                v[d] = rotr(v[d] ^ v[a], 8);
+                v[c] = v[c] + v[d];
+                v[b] = rotr(v[b] ^ v[c], 7);
+            };
+
+            for (int r = 0; r < 10; ++r)
+            {
+                const uint8_t* sg = sigma[r];
+                g(0, 4, 8, 12, m[sg[0]], m[sg[1]]);
+                g(1, 5, 9, 13, m[sg[2]], m[sg[3]]);
+                g(2, 6, 10, 14, m[sg[4]], m[sg[5]]);
+                g(3, 7, 11, 15, m[sg[6]], m[sg[7]]);
+                g(0, 5, 10, 15, m[sg[8]], m[sg[9]]);
+                g(1, 6, 11, 12, m[sg[10]], m[sg[11]]);
+                g(2, 7, 8, 13, m[sg[12]], m[sg[13]]);
+                g(3, 4, 9, 14, m[sg[14]], m[sg[15]]);
+            }
+
+            for (int i = 0; i < 8; ++i)
+                s.h[i] ^= v[i] ^ v[i + 8];
+        }
+
+        inline void blake2sIncrement(Blake2sState& s, uint32_t bytes) noexcept
+        {
+            s.t[0] += bytes;
+            if (s.t[0] < bytes)
+                ++s.t[1];
+        }
+
+        // The final block is only known once finishing, so a full buffer is
+        // compressed when more input arrives rather than when it fills.
+        inline void blake2sUpdate(Blake2sState& s, const uint8_t* data, size_t len) noexcept
+        {
+            while (len > 0)
+            {
+                if (s.bufferLength == 64u)
+                {
+                    blake2sIncrement(s, 64u);
+                    blake2sCompress(s, s.buffer, false);
+                    s.bufferLength = 0;
+                }
+
+                const size_t space = 64u - s.bufferLength;
+                const size_t toCopy = len < space ? len : space;
+                for (size_t i = 0; i < toCopy; ++i)
+                    s.buffer[s.bufferLength + i] = data[i];
+
+                s.bufferLength += static_cast<uint32_t>(toCopy);
+                data += toCopy;
+                len -= toCopy;
+            }
+        }
+
+        inline void blake2sFinal(Blake2sState& s, uint8_t output[32]) noexcept
+        {
+            blake2sIncrement(s, s.bufferLength);
+            for (uint32_t i = s.bufferLength; i < 64u; ++i)
+                s.buffer[i] = 0u;
+            blake2sCompress(s, s.buffer, true);
+
+            for (int i = 0; i < 8; ++i)
+            {
+                output[i * 4]     = static_cast<uint8_t>(s.h[i] & 0xffu);
+                output[i * 4 + 1] = static_cast<uint8_t>((s.h[i] >> 8) & 0xffu);
+                output[i * 4 + 2] = static_cast<uint8_t>((s.h[i] >> 16) & 0xffu);
+                output[i * 4 + 3] = static_cast<uint8_t>((s.h[i] >> 24) & 0xffu);
+            }
+        }
     }
 
-    inline std::array<uint8_t, 32> sha256(const uint8_t* data, size_t len) noexcept
+    // Incremental SHA-256. Copies are independent snapshots, so a shared
+    // prefix can be absorbed once and finished with many different tails;
+    // only the blocks after the snapshot are compressed again.
+    class Sha256Context
     {
+    public:
+        Sha256Context() noexcept { detail::sha256Init(ctx); }
+
+        void update(const uint8_t* data, size_t len) noexcept { detail::sha256Update(ctx, data, len); }
+
+        Sha256Context clone() const noexcept { return *this; }
+
+        // Finishes a copy, so this context can keep absorbing afterwards.
+        std::array<uint8_t, 32> digest() const noexcept
+        {
+            auto copy = ctx;
+            std::array<uint8_t, 32> out{};
+            detail::sha256Final(copy, out.data());
+            return out;
+        }
+
+        uint64_t bytesAbsorbed() const noexcept { return ctx.bitCount / 8u; }
+
+    private:
         detail::Sha256Context ctx;
-        detail::sha256Init(ctx);
-        detail::sha256Update(ctx, data, len);
-        std::array<uint8_t, 32> out{};
-        detail::sha256Final(ctx, out.data());
-        return out;
-    }
+    };
 
-    inline std::array<uint8_t, 32> hmac_sha256(const uint8_t* key, size_t keyLen, const uint8_t* msg, size_t msgLen) noexcept
+    inline std::array<uint8_t, 32> sha256(const uint8_t* data, size_t len) noexcept
     {
-        constexpr size_t blockSize = 64u;
-        uint8_t ipad[blockSize];
-        uint8_t opad[blockSize];
-        uint8_t keyBlock[blockSize];
+        Sha256Context ctx;
+        ctx.update(data, len);
+        return ctx.digest();
+    }
 
-        if (keyLen > blockSize)
+    // HMAC-SHA256 with both key pads absorbed up front. update() feeds the
+    // inner hash, so a clone() taken after a common message prefix also
+    // caches that prefix's midstate.
+    class HmacSha256
+    {
+    public:
+        HmacSha256(const uint8_t* key, size_t keyLen) noexcept
         {
-            auto hashedKey = sha256(key, keyLen);
+            constexpr size_t blockSize = 64u;
+            uint8_t ipad[blockSize];
+            uint8_t opad[blockSize];
+            uint8_t keyBlock[blockSize];
+
+            if (keyLen > blockSize)
+            {
+                auto hashedKey = sha256(key, keyLen);
+                for (size_t i = 0; i < blockSize; ++i)
+                    keyBlock[i] = i < hashedKey.size() ? hashedKey[i] : 0u;
+            }
+            else
+            {
+                for (size_t i = 0; i < blockSize; ++i)
+                    keyBlock[i] = (i < keyLen) ? key[i] : 0u;
+            }
+
             for (size_t i = 0; i < blockSize; ++i)
-                keyBlock[i] = i < hashedKey.size() ? hashedKey[i] : 0u;
+            {
+                ipad[i] = static_cast<uint8_t>(keyBlock[i] ^ 0x36u);
+                opad[i] = static_cast<uint8_t>(keyBlock[i] ^ 0x5cu);
+            }
+
+            inner.update(ipad, blockSize);
+            outer.update(opad, blockSize);
+        }
+
+        void update(const uint8_t* data, size_t len) noexcept { inner.update(data, len); }
+
+        HmacSha256 clone() const noexcept { return *this; }
+
+        std::array<uint8_t, 32> digest() const noexcept
+        {
+            const auto innerHash = inner.digest();
+            auto finish = outer;
+            finish.update(innerHash.data(), innerHash.size());
+            return finish.digest();
         }
-        else
+
+    private:
+        Sha256Context inner;
+        Sha256Context outer;
+    };
+
+    // Keyed BLAKE2s-256 (RFC 7693), a MAC in its own right: no pads and no
+    // second hash, and a message that fits the block after the key costs one
+    // compression. Keys longer than BLAKE2s allows (32 bytes) are replaced by
+    // their SHA-256 first. Like HmacSha256, clone() after a common prefix
+    // keeps that prefix's midstate.
+    class Blake2sMac
+    {
+    public:
+        Blake2sMac(const uint8_t* key, size_t keyLen) noexcept
         {
-            for (size_t i = 0; i < blockSize; ++i)
-                keyBlock[i] = (i < keyLen) ? key[i] : 0u;
+            std::array<uint8_t, 32> hashedKey{};
+            if (keyLen > 32u)
+            {
+                hashedKey = sha256(key, keyLen);
+                key = hashedKey.data();
+                keyLen = hashedKey.size();
+            }
+
+            for (int i = 0; i < 8; ++i)
+                state.h[i] = detail::kBlake2sIv[i];
+            state.h[0] ^= 0x01010000u ^ (static_cast<uint32_t>(keyLen) << 8) ^ 32u;
+
+            if (keyLen > 0)
+            {
+                uint8_t block[64] = {};
+                for (size_t i = 0; i < keyLen; ++i)
+                    block[i] = key[i];
+                detail::blake2sUpdate(state, block, sizeof(block));
+            }
         }
 
-        for (size_t i = 0; i < blockSize; ++i)
+        void update(const uint8_t* data, size_t len) noexcept { detail::blake2sUpdate(state, data, len); }
+
+        Blake2sMac clone() const noexcept { return *this; }
+
+        std::array<uint8_t, 32> digest() const noexcept
         {
-            ipad[i] = static_cast<uint8_t>(keyBlock[i] ^ 0x36u);
-            opad[i] = static_cast<uint8_t>(keyBlock[i] ^ 0x5cu);
+            auto copy = state;
+            std::array<uint8_t, 32> out{};
+            detail::blake2sFinal(copy, out.data());
+            return out;
         }
 
-        detail::Sha256Context innerCtx;
-        detail::sha256Init(innerCtx);
-        detail::sha256Update(innerCtx, ipad, blockSize);
-        detail::sha256Update(innerCtx, msg, msgLen);
-        uint8_t innerHash[32];
-        detail::sha256Final(innerCtx, innerHash);
-
-        detail::Sha256Context outerCtx;
-        detail::sha256Init(outerCtx);
-        detail::sha256Update(outerCtx, opad, blockSize);
-        detail::sha256Update(outerCtx, innerHash, sizeof(innerHash));
-        std::array<uint8_t, 32> result{};
-        detail::sha256Final(outerCtx, result.data());
-        return result;
+    private:
+        detail::Blake2sState state;
+    };
+
+    inline std::array<uint8_t, 32> hmac_sha256(const uint8_t* key, size_t keyLen, const uint8_t* msg, size_t msgLen) noexcept
+    {
+        HmacSha256 mac(key, keyLen);
+        mac.update(msg, msgLen);
+        return mac.digest();
     }
 
     inline std::array<uint8_t, 32> hmac_sha256(const std::array<uint8_t, 32>& key, const uint8_t* msg, size_t msgLen) noexcept
@@ -0,0 +1,321 @@
+#include "identity_store.h"
+#include "license.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+namespace identities
+{
+    namespace
+    {
+        void putVarint(std::vector<uint8_t>& out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back(static_cast<uint8_t>(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(v));
+        }
+
+        const uint8_t* getVarint(const uint8_t* p, uint64_t& v) noexcept
+        {
+            v = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                const uint8_t b = *p++;
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    return p;
+            }
+        }
+
+        // Splits at the last '@'; an address without one is all local part.
+        void splitEmail(const std::string& email, std::string& local, std::string& domain)
+        {
+            const auto at = email.rfind('@');
+            if (at == std::string::npos)
+            {
+                local = email;
+                domain.clear();
+                return;
+            }
+            local = email.substr(0, at);
+            domain = email.substr(at + 1);
+        }
+
+        size_t sharedPrefix(std::string_view a, std::string_view b) noexcept
+        {
+            const size_t n = std::min(a.size(), b.size());
+            size_t i = 0;
+            while (i < n && a[i] == b[i])
+                ++i;
+            return i;
+        }
+    }
+
+    uint32_t IdentityStore::Builder::intern(std::unordered_map<std::string, uint32_t>& ids, std::string&& s)
+    {
+        const auto next = static_cast<uint32_t>(ids.size());
+        return ids.try_emplace(std::move(s), next).first->second;
+    }
+
+    std::string_view IdentityStore::Builder::localOf(const Raw& raw) const noexcept
+    {
+        return std::string_view(locals).substr(raw.localOffset, raw.localLength);
+    }
+
+    size_t IdentityStore::Builder::RawHash::operator()(size_t index) const noexcept
+    {
+        const auto& r = owner->raws[index];
+        size_t h = std::hash<std::string_view>()(owner->localOf(r));
+        for (const uint32_t id : { r.domain, r.last, r.first })
+            h = (h ^ id) * 0x100000001b3ull;
+        return h;
+    }
+
+    bool IdentityStore::Builder::RawEqual::operator()(size_t a, size_t b) const noexcept
+    {
+        const auto& x = owner->raws[a];
+        const auto& y = owner->raws[b];
+        return x.domain == y.domain && x.last == y.last && x.first == y.first
+            && owner->localOf(x) == owner->localOf(y);
+    }
+
+    void IdentityStore::Builder::add(const std::string& first, const std::string& last, const std::string& email)
+    {
+        std::string local, domain;
+        splitEmail(license::normalizeField(email), local, domain);
+
+        Raw raw;
+        raw.first = intern(firstIds, license::normalizeField(first));
+        raw.last = intern(lastIds, license::normalizeField(last));
+        raw.domain = intern(domainIds, std::move(domain));
+        raw.localOffset = locals.size();
+        raw.localLength = static_cast<uint32_t>(local.size());
+        locals += local;
+        raws.push_back(raw);
+
+        // Seen before: take the row back off the end.
+        if (! distinct.insert(raws.size() - 1).second)
+        {
+            raws.pop_back();
+            locals.resize(raw.localOffset);
+        }
+    }
+
+    IdentityStore IdentityStore::Builder::build()
+    {
+        IdentityStore store;
+
+        // Its hashes go stale once ids are remapped and raws sorted.
+        decltype(distinct)(0, RawHash { this }, RawEqual { this }).swap(distinct);
+
+        // Dictionaries sorted, and the insertion-order ids remapped to positions in them.
+        auto sortDictionary = [](std::unordered_map<std::string, uint32_t>& ids, Dictionary& dict)
+        {
+            std::vector<const std::string*> sorted(ids.size());
+            for (const auto& [s, id] : ids)
+                sorted[id] = &s;
+
+            std::vector<uint32_t> order(sorted.size());
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return *sorted[a] < *sorted[b]; });
+
+            std::vector<uint32_t> remap(sorted.size());
+            for (uint32_t pos = 0; pos < order.size(); ++pos)
+            {
+                remap[order[pos]] = pos;
+                dict.arena += *sorted[order[pos]];
+                dict.offsets.push_back(static_cast<uint32_t>(dict.arena.size()));
+            }
+            dict.arena.shrink_to_fit();
+            dict.offsets.shrink_to_fit();
+
+            ids.clear();
+            return remap;
+        };
+
+        const auto firstRemap = sortDictionary(firstIds, store.firstNames);
+        const auto lastRemap = sortDictionary(lastIds, store.lastNames);
+        const auto domainRemap = sortDictionary(domainIds, store.domains);
+
+        for (auto& r : raws)
+        {
+            r.first = firstRemap[r.first];
+            r.last = lastRemap[r.last];
+            r.domain = domainRemap[r.domain];
+        }
+
+        // add() kept them distinct, and the remapping is one-to-one.
+        auto tie = [this](const Raw& r) { return std::make_tuple(r.domain, localOf(r), r.last, r.first); };
+        std::sort(raws.begin(), raws.end(), [&](const Raw& a, const Raw& b) { return tie(a) < tie(b); });
+
+        // Entry: domain delta, shared prefix, suffix length, suffix, last id, first id.
+        // The first entry of each block shares nothing and its delta is from 0.
+        std::string_view previous;
+        uint32_t previousDomain = 0;
+        for (size_t i = 0; i < raws.size(); ++i)
+        {
+            const auto& r = raws[i];
+            const auto local = localOf(r);
+
+            if (i % kBlockSize == 0)
+            {
+                store.blockOffsets.push_back(store.entries.size());
+                previous = {};
+                previousDomain = 0;
+            }
+
+            const size_t shared = r.domain == previousDomain ? sharedPrefix(previous, local) : 0;
+            putVarint(store.entries, r.domain - previousDomain);
+            putVarint(store.entries, shared);
+            putVarint(store.entries, local.size() - shared);
+            store.entries.insert(store.entries.end(), local.begin() + static_cast<std::ptrdiff_t>(shared), local.end());
+            putVarint(store.entries, r.last);
+            putVarint(store.entries, r.first);
+
+            previous = local;
+            previousDomain = r.domain;
+        }
+
+        store.count = raws.size();
+        store.entries.shrink_to_fit();
+        store.blockOffsets.shrink_to_fit();
+
+        raws = {};
+        locals = {};
+        return store;
+    }
+
+    std::string_view IdentityStore::Dictionary::get(uint32_t id) const noexcept
+    {
+        return std::string_view(arena).substr(offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    bool IdentityStore::Dictionary::lookup(std::string_view s, uint32_t& id) const noexcept
+    {
+        size_t lo = 0, hi = size();
+        while (lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if (get(static_cast<uint32_t>(mid)) < s)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == size() || get(static_cast<uint32_t>(lo)) != s)
+            return false;
+
+        id = static_cast<uint32_t>(lo);
+        return true;
+    }
+
+    size_t IdentityStore::Dictionary::memoryBytes() const noexcept
+    {
+        return arena.capacity() + offsets.capacity() * sizeof(uint32_t);
+    }
+
+    int IdentityStore::compare(const Key& a, const Key& b) noexcept
+    {
+        if (a.domain != b.domain)
+            return a.domain < b.domain ? -1 : 1;
+        if (const int c = a.local.compare(b.local); c != 0)
+            return c < 0 ? -1 : 1;
+        if (a.last != b.last)
+            return a.last < b.last ? -1 : 1;
+        if (a.first != b.first)
+            return a.first < b.first ? -1 : 1;
+        return 0;
+    }
+
+    const uint8_t* IdentityStore::decode(const uint8_t* p, Key& key) noexcept
+    {
+        uint64_t domainDelta = 0, shared = 0, suffix = 0, last = 0, first = 0;
+        p = getVarint(p, domainDelta);
+        p = getVarint(p, shared);
+        p = getVarint(p, suffix);
+
+        key.domain += static_cast<uint32_t>(domainDelta);
+        key.local.resize(static_cast<size_t>(shared));
+        key.local.append(reinterpret_cast<const char*>(p), static_cast<size_t>(suffix));
+        p += suffix;
+
+        p = getVarint(p, last);
+        p = getVarint(p, first);
+        key.last = static_cast<uint32_t>(last);
+        key.first = static_cast<uint32_t>(first);
+        return p;
+    }
+
+    Identity IdentityStore::toIdentity(const Key& key) const
+    {
+        Identity id;
+        id.first = std::string(firstNames.get(key.first));
+        id.last = std::string(lastNames.get(key.last));
+        id.email = key.local;
+        if (const auto domain = domains.get(key.domain); ! domain.empty())
+            id.email.append("@").append(domain);
+        return id;
+    }
+
+    Identity IdentityStore::at(size_t index) const
+    {
+        const uint8_t* p = entries.data() + blockOffsets[index / kBlockSize];
+        Key key;
+        for (size_t i = 0; i <= index % kBlockSize; ++i)
+            p = decode(p, key);
+        return toIdentity(key);
+    }
+
+    bool IdentityStore::find(const std::string& first, const std::string& last, const std::string& email, size_t& index) const
+    {
+        if (count == 0)
+            return false;
+
+        std::string domain;
+        Key wanted;
+        splitEmail(license::normalizeField(email), wanted.local, domain);
+        if (! domains.lookup(domain, wanted.domain)
+            || ! lastNames.lookup(license::normalizeField(last), wanted.last)
+            || ! firstNames.lookup(license::normalizeField(first), wanted.first))
+            return false;
+
+        // The last block whose head is not after the wanted key.
+        size_t lo = 0, hi = blockOffsets.size();
+        while (hi - lo > 1)
+        {
+            const size_t mid = (lo + hi) / 2;
+            Key head;
+            decode(entries.data() + blockOffsets[mid], head);
+            if (compare(head, wanted) <= 0)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        const uint8_t* p = entries.data() + blockOffsets[lo];
+        Key key;
+        for (size_t i = lo * kBlockSize; i < count && i < (lo + 1) * kBlockSize; ++i)
+        {
+            p = decode(p, key);
+            const int c = compare(key, wanted);
+            if (c == 0)
+            {
+                index = i;
+                return true;
+            }
+            if (c > 0)
+                break;
+        }
+        return false;
+    }
+
+    size_t IdentityStore::memoryBytes() const noexcept
+    {
+        return sizeof(*this) + firstNames.memoryBytes() + lastNames.memoryBytes() + domains.memoryBytes()
+             + entries.capacity() + blockOffsets.capacity() * sizeof(uint64_t);
+    }
+} // namespace identities
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+    Compressed, read-only set of customer identities.
+
+    A ledger of a hundred million rows held as first/last/email strings costs
+    tens of gigabytes, mostly allocator overhead and the same few domains and
+    names over and over. IdentityStore keeps each distinct normalised
+    identity (license::normalizeField rules) in about ten bytes:
+
+      - first names, last names and email domains are interned into sorted
+        dictionaries and referred to by id;
+      - identities are sorted by (domain, local part, last, first) and
+        written in blocks of 16, each local part front-coded against the one
+        before it, ids and domain deltas as varints;
+      - a sparse index keeps the offset of every block, so at() and find()
+        decode at most one block after a binary search on block heads.
+
+    Build once with Builder, then query from any number of threads.
+*/
+namespace identities
+{
+    struct Identity
+    {
+        std::string first;
+        std::string last;
+        std::string email;
+    };
+
+    class IdentityStore
+    {
+    public:
+        class Builder
+        {
+        public:
+            Builder() = default;
+            Builder(const Builder&) = delete;
+            Builder& operator=(const Builder&) = delete;
+
+            // Normalises the fields. A repeat of an identity already added
+            // is dropped here, so it costs nothing to keep.
+            void add(const std::string& first, const std::string& last, const std::string& email);
+
+            IdentityStore build();
+
+        private:
+            struct Raw
+            {
+                uint32_t domain;
+                uint32_t last;
+                uint32_t first;
+                uint32_t localLength;
+                uint64_t localOffset;
+            };
+
+            // Index into raws, hashed and compared by the identity it names.
+            struct RawHash
+            {
+                const Builder* owner;
+                size_t operator()(size_t index) const noexcept;
+            };
+
+            struct RawEqual
+            {
+                const Builder* owner;
+                bool operator()(size_t a, size_t b) const noexcept;
+            };
+
+            static uint32_t intern(std::unordered_map<std::string, uint32_t>& ids, std::string&& s);
+
+            std::string_view localOf(const Raw& raw) const noexcept;
+
+            std::unordered_map<std::string, uint32_t> firstIds;
+            std::unordered_map<std::string, uint32_t> lastIds;
+            std::unordered_map<std::string, uint32_t> domainIds;
+            std::string locals;
+            std::vector<Raw> raws;
+            std::unordered_set<size_t, RawHash, RawEqual> distinct { 0, RawHash { this }, RawEqual { this } };
+        };
+
+        size_t size() const noexcept { return count; }
+
+        // Identities in store order, 0 .. size() - 1.
+        Identity at(size_t index) const;
+
+        // Sets index to the identity's position; false if it isn't stored.
+        bool find(const std::string& first, const std::string& last, const std::string& email, size_t& index) const;
+
+        size_t memoryBytes() const noexcept;
+
+    private:
+        // Sorted, distinct strings; an id is a position.
+        struct Dictionary
+        {
+            std::string arena;
+            std::vector<uint32_t> offsets { 0 };
+
+            size_t size() const noexcept { return offsets.size() - 1; }
+            std::string_view get(uint32_t id) const noexcept;
+            bool lookup(std::string_view s, uint32_t& id) const noexcept;
+            size_t memoryBytes() const noexcept;
+        };
+
+        struct Key
+        {
+            uint32_t domain = 0;
+            std::string local;
+            uint32_t last = 0;
+            uint32_t first = 0;
+        };
+
+        static int compare(const Key& a, const Key& b) noexcept;
+
+        // Decodes the entry at p into key (whose local holds the previous entry's).
+        static const uint8_t* decode(const uint8_t* p, Key& key) noexcept;
+
+        Identity toIdentity(const Key& key) const;
+
+        static constexpr size_t kBlockSize = 16;
+
+        Dictionary firstNames;
+        Dictionary lastNames;
+        Dictionary domains;
+        std::vector<uint8_t> entries;
+        std::vector<uint64_t> blockOffsets;
+        size_t count = 0;
+    };
+} // namespace identities
@@ -0,0 +1,281 @@
+#include "inbox.h"
+#include "batch.h"
+#include "workers.h"
+
+#if JUCE_LINUX
+ #include <poll.h>
+ #include <sys/inotify.h>
+ #include <unistd.h>
+#endif
+
+namespace inbox
+{
+    namespace
+    {
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+
+        bool isInputFile(const juce::File& file)
+        {
+            return file.hasFileExtension("csv") && ! file.getFileName().startsWithChar('.');
+        }
+    }
+
+    Watcher::Watcher(const juce::File& inboxDirectory, const juce::File& outboxDirectory)
+        : juce::Thread("Inbox watcher"),
+          inboxDir(inboxDirectory),
+          outboxDir(outboxDirectory),
+          stateFile(outboxDirectory.getChildFile(".inbox-offsets"))
+    {
+    }
+
+    Watcher::~Watcher()
+    {
+        stop();
+    }
+
+    bool Watcher::start()
+    {
+        if (! inboxDir.isDirectory() || ! outboxDir.createDirectory().wasOk())
+            return false;
+
+        loadOffsets();
+        return startThread();
+    }
+
+    void Watcher::stop()
+    {
+        stopThread(2000);
+
+        // Jobs capture this, so they must drain before we go away.
+        while (jobsInFlight.load() > 0)
+            juce::Thread::sleep(5);
+    }
+
+    void Watcher::run()
+    {
+        scanAll();
+
+       #if JUCE_LINUX
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, inboxDir.getFullPathName().toRawUTF8(),
+                                         IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO) >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+
+            while (! threadShouldExit())
+            {
+                pollfd pfd { fd, POLLIN, 0 };
+                if (poll(&pfd, 1, 250) <= 0)
+                    continue;
+
+                ssize_t n;
+                while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (ssize_t pos = 0; pos < n;)
+                    {
+                        const auto* ev = reinterpret_cast<const inotify_event*>(buffer + pos);
+                        if ((ev->mask & IN_Q_OVERFLOW) != 0)
+                            scanAll(true); // events were dropped, so any file may have grown
+                        else if (ev->len > 0 && (ev->mask & IN_ISDIR) == 0)
+                            schedule(inboxDir.getChildFile(juce::String::fromUTF8(ev->name)));
+                        pos += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+                    }
+                }
+            }
+
+            close(fd);
+            return;
+        }
+
+        if (fd >= 0)
+            close(fd);
+       #endif
+
+        pollLoop();
+    }
+
+    void Watcher::pollLoop()
+    {
+        while (! threadShouldExit())
+        {
+            wait(1000);
+            scanAll();
+        }
+    }
+
+    void Watcher::scanAll(bool everyFile)
+    {
+        for (const auto& entry : juce::RangedDirectoryIterator(inboxDir, false, "*.csv", juce::File::findFiles))
+        {
+            const auto& file = entry.getFile();
+            const auto size = entry.getFileSize();
+            auto& seen = lastSeenSizes[file.getFileName()];
+
+            if (everyFile || size != seen)
+            {
+                seen = size;
+                schedule(file);
+            }
+        }
+    }
+
+    void Watcher::schedule(const juce::File& file)
+    {
+        if (! isInputFile(file))
+            return;
+
+        const auto name = file.getFileName();
+        {
+            const juce::ScopedLock sl(lock);
+
+            // One job per file at a time; a change mid-run just triggers another pass.
+            if (running.count(name) != 0)
+            {
+                dirty.insert(name);
+                return;
+            }
+
+            running.insert(name);
+        }
+
+        ++jobsInFlight;
+        workers::submit(workers::Priority::bulk, [this, file] { processFile(file); --jobsInFlight; });
+    }
+
+    void Watcher::processFile(const juce::File& file)
+    {
+        const auto name = file.getFileName();
+
+        for (;;)
+        {
+            processNewLines(file);
+
+            const juce::ScopedLock sl(lock);
+            if (dirty.erase(name) == 0 || threadShouldExit())
+            {
+                running.erase(name);
+                return;
+            }
+        }
+    }
+
+    void Watcher::processNewLines(const juce::File& file)
+    {
+        const auto name = file.getFileName();
+        juce::int64 offset = 0;
+        {
+            const juce::ScopedLock sl(lock);
+            offset = offsets[name].input;
+        }
+
+        const auto size = file.getSize();
+        if (size < offset)
+            offset = 0; // truncated or replaced: start over
+
+        if (size == offset)
+            return;
+
+        juce::FileInputStream in(file);
+        if (! in.openedOk() || ! in.setPosition(offset))
+            return;
+
+        const auto outFile = outputFor(name);
+        juce::MemoryBlock pending;
+
+        while (offset + static_cast<juce::int64>(pending.getSize()) < size && ! threadShouldExit())
+        {
+            const auto keep = pending.getSize();
+            const auto wanted = juce::jmin(kChunkBytes, size - offset - static_cast<juce::int64>(keep));
+            pending.setSize(keep + static_cast<size_t>(wanted));
+            const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(wanted));
+            pending.setSize(keep + static_cast<size_t>(juce::jmax(0, got)));
+
+            if (got <= 0)
+                return;
+
+            // Leave a partially written trailing line for the next chunk or pass.
+            const auto* data = static_cast<const char*>(pending.getData());
+            size_t cut = pending.getSize();
+            while (cut > 0 && data[cut - 1] != '\n')
+                --cut;
+
+            if (cut == 0)
+                continue; // one line longer than a chunk: keep reading
+
+            const auto rows = batch::issueFromCsv(juce::String::fromUTF8(data, static_cast<int>(cut)), offset == 0);
+            if (! rows.empty() && ! batch::appendCsv(outFile, rows))
+                return; // offset stays put, so the next event retries
+
+            offset += static_cast<juce::int64>(cut);
+            pending.removeSection(0, cut);
+
+            {
+                const juce::ScopedLock sl(lock);
+                offsets[name] = { offset, outFile.getSize() };
+            }
+            saveOffsets();
+        }
+    }
+
+    juce::File Watcher::outputFor(const juce::String& inputName) const
+    {
+        return outboxDir.getChildFile(juce::File::createFileWithoutCheckingPath(inputName).getFileNameWithoutExtension()
+                                      + ".licenses.csv");
+    }
+
+    void Watcher::loadOffsets()
+    {
+        juce::StringArray lines;
+        stateFile.readLines(lines);
+
+        const juce::ScopedLock sl(lock);
+        for (const auto& line : lines)
+        {
+            // "<input offset>\t<output length>\t<name>"; older files have no output length.
+            auto fields = juce::StringArray::fromTokens(line, "\t", {});
+            if (fields.size() < 2 || fields[0].isEmpty())
+                continue;
+
+            Progress progress;
+            progress.input = fields[0].getLargeIntValue();
+            if (fields.size() >= 3)
+            {
+                progress.output = fields[1].getLargeIntValue();
+                fields.removeRange(0, 2);
+            }
+            else
+            {
+                fields.remove(0);
+            }
+
+            const auto name = fields.joinIntoString("\t");
+            offsets[name] = progress;
+
+            // Output appended after the last saved state belongs to a chunk that
+            // was never committed; drop it so that chunk is issued exactly once.
+            const auto outFile = outputFor(name);
+            if (progress.output >= 0 && outFile.getSize() > progress.output)
+            {
+                juce::FileOutputStream out(outFile);
+                if (out.openedOk() && out.setPosition(progress.output))
+                    out.truncate();
+            }
+        }
+    }
+
+    void Watcher::saveOffsets()
+    {
+        // Serialised so an older snapshot can never overwrite a newer one.
+        const juce::ScopedLock saving(saveLock);
+
+        juce::String text;
+        {
+            const juce::ScopedLock sl(lock);
+            for (const auto& [name, progress] : offsets)
+                text << juce::String(progress.input) << '\t' << juce::String(progress.output) << '\t' << name << '\n';
+        }
+
+        // replaceWithText goes through a temporary file, so a crash never leaves it half written.
+        stateFile.replaceWithText(text);
+    }
+} // namespace inbox
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <map>
+#include <set>
+
+/*
+    Watched inbox for order-system CSV drops (--watch <inbox> <outbox>).
+
+    New or grown *.csv files in the inbox are pushed through the batch
+    issuance path on the shared worker pool, several files at once. Only
+    complete lines are consumed, in chunks of at most 8 MB, so a large drop
+    never has to fit in memory. Results for in/name.csv are appended to
+    out/name.licenses.csv.
+
+    After each chunk the outbox state records both the byte offset reached in
+    the input and the length of the output it produced. On start an output
+    longer than its recorded length (a crash between the append and the
+    state write) is cut back, so the chunk is issued again instead of twice.
+
+    Linux uses inotify, rescanning the whole inbox if the event queue
+    overflows; other platforms poll the directory once a second.
+*/
+namespace inbox
+{
+    class Watcher : private juce::Thread
+    {
+    public:
+        Watcher(const juce::File& inboxDirectory, const juce::File& outboxDirectory);
+        ~Watcher() override;
+
+        // Creates the outbox if needed, restores offsets and starts watching.
+        bool start();
+        void stop();
+
+    private:
+        void run() override;
+        void pollLoop();
+        void scanAll(bool everyFile = false);
+        void schedule(const juce::File& file);
+        void processFile(const juce::File& file);
+        void processNewLines(const juce::File& file);
+        juce::File outputFor(const juce::String& inputName) const;
+
+        void loadOffsets();
+        void saveOffsets();
+
+        struct Progress
+        {
+            juce::int64 input = 0;   // bytes of the input consumed
+            juce::int64 output = -1; // length of its output at that point; -1 if unknown
+        };
+
+        const juce::File inboxDir;
+        const juce::File outboxDir;
+        const juce::File stateFile;
+
+        juce::CriticalSection lock;
+        juce::CriticalSection saveLock;
+        std::map<juce::String, Progress> offsets;
+        std::map<juce::String, juce::int64> lastSeenSizes;
+        std::set<juce::String> running;
+        std::set<juce::String> dirty;
+        std::atomic<int> jobsInFlight { 0 };
+
+        JUCE_DECLARE_NON_COPYABLE (Watcher)
+    };
+} // namespace inbox
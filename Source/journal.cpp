@@ -0,0 +1,195 @@
+#include "journal.h"
+#include "batch.h"
+#include "crypto_small.h"
+#include "license.h"
+#include "trace.h"
+
+namespace journal
+{
+    namespace
+    {
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+        constexpr size_t kHeadBytes = 64 * 1024;
+
+        struct State
+        {
+            juce::String inputPath;
+            juce::int64 inputSize = 0;
+            juce::int64 inputModified = 0;
+            juce::String inputHead;
+            juce::String date;
+            juce::int64 inputOffset = 0;
+            juce::int64 outputBytes = 0;
+            juce::int64 rows = 0;
+        };
+
+        juce::String hashHead(const juce::File& input)
+        {
+            juce::FileInputStream in(input);
+            juce::MemoryBlock head;
+            if (in.openedOk())
+                in.readIntoMemoryBlock(head, static_cast<juce::int64>(kHeadBytes));
+
+            crypto_small::Sha256Context ctx;
+            ctx.update(static_cast<const uint8_t*>(head.getData()), head.getSize());
+            const auto digest = ctx.digest();
+            return juce::String::toHexString(digest.data(), static_cast<int>(digest.size()), 0);
+        }
+
+        State identify(const juce::File& input)
+        {
+            State state;
+            state.inputPath = input.getFullPathName();
+            state.inputSize = input.getSize();
+            state.inputModified = input.getLastModificationTime().toMilliseconds();
+            state.inputHead = hashHead(input);
+            return state;
+        }
+
+        bool sameInput(const State& a, const State& b)
+        {
+            return a.inputPath == b.inputPath && a.inputSize == b.inputSize
+                && a.inputModified == b.inputModified && a.inputHead == b.inputHead;
+        }
+
+        State load(const juce::File& file)
+        {
+            juce::StringArray lines;
+            file.readLines(lines);
+
+            juce::StringPairArray values;
+            for (const auto& line : lines)
+            {
+                const auto eq = line.indexOfChar('=');
+                if (eq > 0)
+                    values.set(line.substring(0, eq), line.substring(eq + 1));
+            }
+
+            State state;
+            state.inputPath = values["input"];
+            state.inputSize = values["size"].getLargeIntValue();
+            state.inputModified = values["modified"].getLargeIntValue();
+            state.inputHead = values["head"];
+            state.date = values["date"];
+            state.inputOffset = values["inputOffset"].getLargeIntValue();
+            state.outputBytes = values["outputBytes"].getLargeIntValue();
+            state.rows = values["rows"].getLargeIntValue();
+            return state;
+        }
+
+        // replaceWithText goes through a temporary file, so a crash leaves
+        // either the previous checkpoint or this one.
+        bool save(const juce::File& file, const State& state)
+        {
+            juce::String text;
+            text << "input=" << state.inputPath << '\n'
+                 << "size=" << state.inputSize << '\n'
+                 << "modified=" << state.inputModified << '\n'
+                 << "head=" << state.inputHead << '\n'
+                 << "date=" << state.date << '\n'
+                 << "inputOffset=" << state.inputOffset << '\n'
+                 << "outputBytes=" << state.outputBytes << '\n'
+                 << "rows=" << state.rows << '\n';
+            return file.replaceWithText(text);
+        }
+
+        bool canResume(const State& saved, const State& current, const juce::File& output)
+        {
+            return sameInput(saved, current)
+                && saved.date.length() == 8 && saved.date.containsOnly("0123456789")
+                && saved.inputOffset >= 0 && saved.inputOffset <= current.inputSize
+                && saved.outputBytes >= 0 && output.existsAsFile() && output.getSize() >= saved.outputBytes;
+        }
+    }
+
+    juce::File journalFileFor(const juce::File& output)
+    {
+        return output.getSiblingFile(output.getFileName() + ".journal");
+    }
+
+    juce::Result run(const juce::File& input, const juce::File& output, Summary& summary)
+    {
+        SMK_TRACE_SCOPE("journalRun");
+
+        if (! input.existsAsFile())
+            return juce::Result::fail("input not found: " + input.getFullPathName());
+
+        const auto journalFile = journalFileFor(output);
+        auto state = identify(input);
+
+        if (journalFile.existsAsFile())
+        {
+            const auto saved = load(journalFile);
+            if (canResume(saved, state, output))
+            {
+                state = saved;
+                summary.resumedAtRow = state.rows;
+            }
+        }
+
+        if (summary.resumedAtRow < 0)
+        {
+            state.date = license::currentDate();
+            output.deleteFile();
+        }
+
+        // Anything past the last checkpoint was written by a run that died
+        // before recording it, and is about to be written again.
+        juce::FileOutputStream out(output);
+        if (! out.openedOk() || ! out.setPosition(state.outputBytes) || out.truncate().failed())
+            return juce::Result::fail("failed to write " + output.getFullPathName());
+
+        juce::FileInputStream in(input);
+        if (! in.openedOk() || ! in.setPosition(state.inputOffset))
+            return juce::Result::fail("failed to read " + input.getFullPathName());
+
+        const auto date = state.date.toStdString();
+        juce::int64 remaining = state.inputSize - state.inputOffset;
+        juce::MemoryBlock pending;
+
+        while (remaining > 0)
+        {
+            const auto want = static_cast<size_t>(juce::jmin(remaining, kChunkBytes));
+            const auto keep = pending.getSize();
+            pending.setSize(keep + want);
+            const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(want));
+            if (got <= 0)
+                return juce::Result::fail("unexpected end of input");
+
+            pending.setSize(keep + static_cast<size_t>(got));
+            remaining -= got;
+
+            // Checkpoints fall on line boundaries; a partial line waits for more input.
+            const auto* data = static_cast<const char*>(pending.getData());
+            size_t cut = pending.getSize();
+            if (remaining > 0)
+                while (cut > 0 && data[cut - 1] != '\n')
+                    --cut;
+
+            if (cut == 0)
+                continue;
+
+            const auto rows = batch::issueFromCsv(juce::String::fromUTF8(data, static_cast<int>(cut)),
+                                                  state.inputOffset == 0, date);
+
+            juce::MemoryOutputStream formatted;
+            batch::writeRows(formatted, rows, state.outputBytes == 0);
+            out.write(formatted.getData(), formatted.getDataSize());
+            out.flush();
+            if (out.getStatus().failed())
+                return out.getStatus();
+
+            state.inputOffset += static_cast<juce::int64>(cut);
+            state.outputBytes += static_cast<juce::int64>(formatted.getDataSize());
+            state.rows += static_cast<juce::int64>(rows.size());
+            pending.removeSection(0, cut);
+
+            if (! save(journalFile, state))
+                return juce::Result::fail("failed to write " + journalFile.getFullPathName());
+        }
+
+        journalFile.deleteFile();
+        summary.rows = state.rows;
+        return juce::Result::ok();
+    }
+} // namespace journal
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <string>
+
+/*
+    Crash-resumable batch issuance.
+
+    run() streams the input in 8 MB chunks of whole lines. After appending
+    each chunk's signed rows to the output it checkpoints <out>.journal with
+    the input's identity (path, size, modification time, SHA-256 of the
+    first 64 KB), the issue date, the input offset consumed, the output
+    bytes flushed and the row count.
+
+    If the process dies, a rerun with the same input truncates the output
+    back to the journalled size and carries on from the journalled offset,
+    signing with the journalled date, so the finished file is byte-identical
+    to an uninterrupted run. The journal is removed once the output is
+    complete.
+*/
+namespace journal
+{
+    struct Summary
+    {
+        juce::int64 rows = 0;
+        juce::int64 resumedAtRow = -1;  // -1 for a fresh run
+    };
+
+    juce::File journalFileFor(const juce::File& output);
+
+    juce::Result run(const juce::File& input, const juce::File& output, Summary& summary);
+} // namespace journal
@@ -3,31 +3,33 @@
 
     IMPORTANT: Replace the SECRET array below with your own random bytes
     before shipping. The license format is VERSION-DATE-XXXX-XXXX-XXXX,
-    where VERSION is currently "V1", DATE is UTC YYYYMMDD, and the
-    suffix is derived from the first 18 Base32 characters of the
-    HMAC-SHA256 signature of the payload "first|last|email|version|date".
+    where VERSION is "V1" or "V2" (see Scheme), DATE is UTC YYYYMMDD, and
+    the suffix is derived from the first 18 Base32 characters of the
+    scheme's MAC (HMAC-SHA256 for V1, keyed BLAKE2s for V2) of the
+    payload "first|last|email|version|date".
     The UI displays up to the first 12 characters (three 4-character
     groups) for readability.
 */
 
 #include "crypto_small.h"
-#include "base32.h"
 #include "license.h"
+#include "license_format.h"
+#include "metrics.h"
+#include "trace.h"
 
-#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
-#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
-#include <vector>
 
 namespace license {
-    using crypto_small::hmac_sha256;
-
     namespace {
-        static const char* kVersion = "V1";
+        const char* versionTag(Scheme scheme)
+        {
+            return scheme == Scheme::v2 ? "V2" : "V1";
+        }
 
         // TODO: REPLACE SECRET with 32+ random bytes before release.
         static const uint8_t SECRET[] = {
@@ -48,48 +50,19 @@ namespace license {
             return s.substr(start, end - start);
         }
 
-        bool isDigits(const std::string& s)
-        {
-            return std::all_of(s.begin(), s.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
-        }
-
-        bool constTimeEquals(const std::string& a, const std::string& b)
-        {
-            if (a.size() != b.size())
-                return false;
-            unsigned char result = 0;
-            for (size_t i = 0; i < a.size(); ++i)
-            {
-                result |= static_cast<unsigned char>(a[i] ^ b[i]);
-            }
-            return result == 0;
-        }
-
-        std::string normalizeField(const std::string& s)
+        // Everything in the payload that precedes the date.
+        std::string makePayloadPrefix(const std::string& first,
+                                      const std::string& last,
+                                      const std::string& email,
+                                      const std::string& version)
         {
-            std::string trimmed = trim(s);
-            std::string out;
-            out.reserve(trimmed.size());
-            bool inSpace = false;
-            for (char ch : trimmed)
-            {
-                unsigned char uch = static_cast<unsigned char>(ch);
-                const bool isSpace = std::isspace(uch) != 0;
-                if (isSpace)
-                {
-                    if (! inSpace && ! out.empty())
-                    {
-                        out.push_back(' ');
-                        inSpace = true;
-                    }
-                }
-                else
-                {
-                    out.push_back(static_cast<char>(std::tolower(uch)));
-                    inSpace = false;
-                }
-            }
-            return out;
+            metrics::ScopedTimer timer(metrics::Stage::normalize);
+            std::ostringstream oss;
+            oss << normalizeField(first) << '|'
+                << normalizeField(last) << '|'
+                << normalizeField(email) << '|'
+                << version << '|';
+            return oss.str();
         }
 
         std::string makePayload(const std::string& first,
@@ -98,13 +71,7 @@ namespace license {
                                 const std::string& version,
                                 const std::string& yyyymmdd)
         {
-            std::ostringstream oss;
-            oss << normalizeField(first) << '|'
-                << normalizeField(last) << '|'
-                << normalizeField(email) << '|'
-                << version << '|'
-                << yyyymmdd;
-            return oss.str();
+            return makePayloadPrefix(first, last, email, version) + yyyymmdd;
         }
 
         std::string utcDateYYYYMMDD()
@@ -125,34 +92,134 @@ namespace license {
         }
     }
 
+    namespace
+    {
+        // Span and metrics stage for each MAC, so V1 and V2 signing are told apart.
+        template <typename Mac>
+        struct MacStage;
+
+        template <>
+        struct MacStage<crypto_small::HmacSha256>
+        {
+            static constexpr const char* span = "hmac_sha256";
+            static constexpr metrics::Stage stage = metrics::Stage::hmac;
+        };
+
+        template <>
+        struct MacStage<crypto_small::Blake2sMac>
+        {
+            static constexpr const char* span = "blake2s";
+            static constexpr metrics::Stage stage = metrics::Stage::blake2s;
+        };
+
+        template <typename Mac>
+        std::array<uint8_t, 32> signTail(const Mac& midstate, const std::string& tail)
+        {
+            SMK_TRACE_SCOPE(MacStage<Mac>::span);
+            metrics::ScopedTimer timer(MacStage<Mac>::stage);
+            auto mac = midstate.clone();
+            mac.update(reinterpret_cast<const uint8_t*>(tail.data()), tail.size());
+            return mac.digest();
+        }
+
+        std::string formatLicense(Scheme scheme, const std::string& date, const std::array<uint8_t, 32>& digest)
+        {
+            metrics::ScopedTimer timer(metrics::Stage::encode);
+            if (date.size() != StandardFormat::dateChars)
+                return {};
+
+            std::string formatted(StandardFormat::length, '\0');
+            StandardFormat::format(formatted.data(), versionTag(scheme), date.data(), digest);
+            return formatted;
+        }
+
+        // Splits a key into its scheme, date and signature, rejecting
+        // anything that isn't well formed for a known version.
+        bool parseLicense(const std::string& licenseStr, Scheme& scheme, std::string& date,
+                          StandardFormat::Signature& signature)
+        {
+            StandardFormat::Text text;
+            if (! StandardFormat::parse(licenseStr, text))
+                return false;
+
+            const auto version = StandardFormat::version(text);
+            if (version == versionTag(Scheme::v1))
+                scheme = Scheme::v1;
+            else if (version == versionTag(Scheme::v2))
+                scheme = Scheme::v2;
+            else
+                return false;
+
+            date.assign(StandardFormat::date(text));
+            signature = StandardFormat::signature(text);
+            return true;
+        }
+
+        bool signatureMatches(const StandardFormat::Signature& signature, const std::array<uint8_t, 32>& digest)
+        {
+            metrics::ScopedTimer timer(metrics::Stage::encode);
+            return StandardFormat::signaturesMatch(signature, StandardFormat::signatureOf(digest));
+        }
+
+        // The first twelve Base32 characters are the digest's top 60 bits.
+        uint64_t signatureBits(const std::array<uint8_t, 32>& digest)
+        {
+            uint64_t bits = 0;
+            for (size_t i = 0; i < 8; ++i)
+                bits = (bits << 8) | digest[i];
+            return bits >> 4;
+        }
+    }
+
+    std::string normalizeField(const std::string& s)
+    {
+        std::string trimmed = trim(s);
+        std::string out;
+        out.reserve(trimmed.size());
+        bool inSpace = false;
+        for (char ch : trimmed)
+        {
+            unsigned char uch = static_cast<unsigned char>(ch);
+            const bool isSpace = std::isspace(uch) != 0;
+            if (isSpace)
+            {
+                if (! inSpace && ! out.empty())
+                {
+                    out.push_back(' ');
+                    inSpace = true;
+                }
+            }
+            else
+            {
+                out.push_back(static_cast<char>(std::tolower(uch)));
+                inSpace = false;
+            }
+        }
+        return out;
+    }
+
+    bool schemeFromName(const std::string& name, Scheme& out)
+    {
+        const auto lowered = normalizeField(name);
+        if (lowered == "v1")
+            out = Scheme::v1;
+        else if (lowered == "v2")
+            out = Scheme::v2;
+        else
+            return false;
+        return true;
+    }
+
+    std::string currentDate()
+    {
+        return utcDateYYYYMMDD();
+    }
+
     std::string makeLicense(const std::string& first,
                             const std::string& last,
                             const std::string& email)
     {
-        const std::string date = utcDateYYYYMMDD();
-        const std::string payload = makePayload(first, last, email, kVersion, date);
-        const auto digest = hmac_sha256(SECRET, sizeof(SECRET),
-                                        reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
-        const std::string encoded = base32::base32_encode(digest.data(), digest.size());
-        const std::string signatureFull = encoded.substr(0, std::min<size_t>(18, encoded.size()));
-        if (signatureFull.size() < 12)
-            return {};
-        const std::string signature = signatureFull.substr(0, 12);
-
-        std::string formatted;
-        const size_t versionLen = std::strlen(kVersion);
-        formatted.reserve(versionLen + 1 + date.size() + 1 + 4 + 1 + 4 + 1 + 4);
-        formatted.append(kVersion);
-        formatted.push_back('-');
-        formatted.append(date);
-        formatted.push_back('-');
-        formatted.append(signature.substr(0, 4));
-        formatted.push_back('-');
-        formatted.append(signature.substr(4, 4));
-        formatted.push_back('-');
-        formatted.append(signature.substr(8, 4));
-
-        return formatted;
+        return SigningKey::builtIn().makeLicense(first, last, email, utcDateYYYYMMDD());
     }
 
     bool verifyLicense(const std::string& licenseStr,
@@ -160,65 +227,153 @@ namespace license {
                        const std::string& last,
                        const std::string& email)
     {
-        if (licenseStr.empty())
+        return SigningKey::builtIn().verifyLicense(licenseStr, first, last, email);
+    }
+
+    std::string identityOf(const std::string& first,
+                           const std::string& last,
+                           const std::string& email)
+    {
+        return makePayloadPrefix(first, last, email, versionTag(Scheme::v1));
+    }
+
+    SigningKey::SigningKey(const uint8_t* secret, size_t length) noexcept
+        : mac(secret, length),
+          blake(secret, length)
+    {
+        static std::atomic<uint64_t> nextSerial { 1 };
+        serial = nextSerial.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The built-in secret's pads are compressed once per process instead of
+    // once per signature.
+    const SigningKey& SigningKey::builtIn()
+    {
+        static const SigningKey key(SECRET, sizeof(SECRET));
+        return key;
+    }
+
+    std::array<uint8_t, 32> SigningKey::sign(Scheme scheme, const std::string& payload) const
+    {
+        return scheme == Scheme::v2 ? signTail(blake, payload) : signTail(mac, payload);
+    }
+
+    std::string SigningKey::makeLicense(const std::string& first,
+                                        const std::string& last,
+                                        const std::string& email,
+                                        const std::string& yyyymmdd,
+                                        Scheme scheme) const
+    {
+        SMK_TRACE_SCOPE("makeLicense");
+        const std::string payload = makePayload(first, last, email, versionTag(scheme), yyyymmdd);
+        return formatLicense(scheme, yyyymmdd, sign(scheme, payload));
+    }
+
+    bool SigningKey::verifyLicense(const std::string& licenseStr,
+                                   const std::string& first,
+                                   const std::string& last,
+                                   const std::string& email) const
+    {
+        SMK_TRACE_SCOPE("verifyLicense");
+        metrics::ScopedTimer timer(metrics::Stage::verify);
+
+        Scheme scheme;
+        std::string date;
+        StandardFormat::Signature signature;
+        if (! parseLicense(licenseStr, scheme, date, signature))
             return false;
 
-        std::string cleaned;
-        cleaned.reserve(licenseStr.size());
-        for (char c : licenseStr)
-        {
-            if (std::isspace(static_cast<unsigned char>(c)))
-                continue;
-            cleaned.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
-        }
+        const std::string payload = makePayload(first, last, email, versionTag(scheme), date);
+        return signatureMatches(signature, sign(scheme, payload));
+    }
+
+    IdentitySigner::IdentitySigner(const std::string& first,
+                                   const std::string& last,
+                                   const std::string& email,
+                                   const SigningKey& key)
+        : IdentitySigner(first, last, email, { Scheme::v1, Scheme::v2 }, key)
+    {
+    }
+
+    IdentitySigner::IdentitySigner(const std::string& first,
+                                   const std::string& last,
+                                   const std::string& email,
+                                   std::initializer_list<Scheme> schemes,
+                                   const SigningKey& key)
+        : prefix(makePayloadPrefix(first, last, email, versionTag(Scheme::v1))),
+          v2Prefix(prefix),
+          midstate(key.mac.clone()),
+          blakeMidstate(key.blake.clone())
+    {
+        // The V2 payload differs only in the version field before the final '|'.
+        v2Prefix.replace(v2Prefix.size() - 3, 2, versionTag(Scheme::v2));
 
-        std::vector<std::string> parts;
-        size_t start = 0;
-        while (start <= cleaned.size())
+        for (const auto scheme : schemes)
         {
-            size_t pos = cleaned.find('-', start);
-            if (pos == std::string::npos)
+            if (scheme == Scheme::v1 && ! v1Prepared)
+            {
+                midstate.update(reinterpret_cast<const uint8_t*>(prefix.data()), prefix.size());
+                v1Prepared = true;
+            }
+            else if (scheme == Scheme::v2 && ! v2Prepared)
             {
-                parts.push_back(cleaned.substr(start));
-                break;
+                blakeMidstate.update(reinterpret_cast<const uint8_t*>(v2Prefix.data()), v2Prefix.size());
+                v2Prepared = true;
             }
-            parts.push_back(cleaned.substr(start, pos - start));
-            start = pos + 1;
         }
+    }
 
-        if (parts.size() != 5)
-            return false;
+    std::array<uint8_t, 32> IdentitySigner::sign(Scheme scheme, const std::string& yyyymmdd) const
+    {
+        if (scheme == Scheme::v2)
+            return v2Prepared ? signTail(blakeMidstate, yyyymmdd) : signTail(blakeMidstate, v2Prefix + yyyymmdd);
+        return v1Prepared ? signTail(midstate, yyyymmdd) : signTail(midstate, prefix + yyyymmdd);
+    }
 
-        const std::string& version = parts[0];
-        const std::string& date = parts[1];
-        if (version != kVersion || date.size() != 8 || ! isDigits(date))
-            return false;
+    std::string IdentitySigner::makeLicense(const std::string& yyyymmdd, Scheme scheme) const
+    {
+        return formatLicense(scheme, yyyymmdd, sign(scheme, yyyymmdd));
+    }
 
-        for (size_t i = 2; i < parts.size(); ++i)
-        {
-            if (parts[i].empty())
-                return false;
-        }
+    bool IdentitySigner::verifyLicense(const std::string& licenseStr) const
+    {
+        metrics::ScopedTimer timer(metrics::Stage::verify);
 
-        std::string signature = parts[2] + parts[3] + parts[4];
-        if (signature.size() != 12)
+        Scheme scheme;
+        std::string date;
+        StandardFormat::Signature signature;
+        if (! parseLicense(licenseStr, scheme, date, signature))
             return false;
 
-        if (! std::all_of(signature.begin(), signature.end(), [](char c)
+        return signatureMatches(signature, sign(scheme, date));
+    }
+
+    PackedLicense IdentitySigner::makePacked(const std::string& yyyymmdd, Scheme scheme) const
+    {
+        PackedLicense key;
+        if (yyyymmdd.size() != StandardFormat::dateChars)
+            return key;
+
+        for (const char c : yyyymmdd)
         {
-            return (c >= 'A' && c <= 'Z') || (c >= '2' && c <= '7');
-        }))
-            return false;
+            if (c < '0' || c > '9')
+                return key;
+            key.date = key.date * 10 + static_cast<uint32_t>(c - '0');
+        }
 
-        const std::string payload = makePayload(first, last, email, version, date);
-        const auto digest = hmac_sha256(SECRET, sizeof(SECRET),
-                                        reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
-        const std::string encoded = base32::base32_encode(digest.data(), digest.size());
-        const std::string expected = encoded.substr(0, 12);
+        key.version = static_cast<uint8_t>(scheme);
+        key.signature = signatureBits(sign(scheme, yyyymmdd));
+        return key;
+    }
+
+    bool IdentitySigner::verifyLicense(const PackedLicense& key) const
+    {
+        metrics::ScopedTimer timer(metrics::Stage::verify);
 
-        if (expected.size() != signature.size())
+        if (key.version != static_cast<uint8_t>(Scheme::v1) && key.version != static_cast<uint8_t>(Scheme::v2))
             return false;
 
-        return constTimeEquals(signature, expected);
+        const auto expected = signatureBits(sign(static_cast<Scheme>(key.version), key.dateText()));
+        return (expected ^ key.signature) == 0;
     }
 } // namespace license
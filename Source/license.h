@@ -1,8 +1,30 @@
 #pragma once
 
+#include "crypto_small.h"
+#include "packed_license.h"
+#include <array>
+#include <initializer_list>
 #include <string>
 
 namespace license {
+    // Signature schemes, named by a key's leading "V1-" / "V2-". Keys of
+    // both look alike and verification follows the prefix.
+    //   v1  HMAC-SHA256 of "first|last|email|V1|date"
+    //   v2  keyed BLAKE2s-256 of "first|last|email|V2|date": one or two
+    //       ten-round compressions where V1 needs three 64-round ones
+    enum class Scheme : uint8_t
+    {
+        v1 = 1,
+        v2 = 2
+    };
+
+    // What new keys are issued as unless a caller opts into another scheme.
+    // Stays V1 until the verifiers shipped in the product understand V2.
+    constexpr Scheme kIssueScheme = Scheme::v1;
+
+    // "v1" or "v2", either case. Returns false for anything else.
+    bool schemeFromName(const std::string& name, Scheme& out);
+
     std::string makeLicense(const std::string& first,
                             const std::string& last,
                             const std::string& email);
@@ -11,4 +33,92 @@ namespace license {
                        const std::string& first,
                        const std::string& last,
                        const std::string& email);
+
+    // Today's UTC date as YYYYMMDD, the date makeLicense stamps.
+    std::string currentDate();
+
+    // One field as signatures see it: trimmed, lower-cased, inner whitespace
+    // runs collapsed to a single space.
+    std::string normalizeField(const std::string& s);
+
+    // The normalised "first|last|email|V1|" that a license signs before its date.
+    std::string identityOf(const std::string& first,
+                           const std::string& last,
+                           const std::string& email);
+
+    // A secret with its HMAC pads already compressed, for signing many
+    // licenses with it. The free functions above use builtIn(); services
+    // embedding the library can key their own (see smkeygen.h).
+    class SigningKey
+    {
+    public:
+        SigningKey(const uint8_t* secret, size_t length) noexcept;
+
+        static const SigningKey& builtIn();
+
+        // yyyymmdd is trusted to be a valid date here.
+        std::string makeLicense(const std::string& first,
+                                const std::string& last,
+                                const std::string& email,
+                                const std::string& yyyymmdd,
+                                Scheme scheme = kIssueScheme) const;
+
+        bool verifyLicense(const std::string& licenseStr,
+                           const std::string& first,
+                           const std::string& last,
+                           const std::string& email) const;
+
+        // Unique per key constructed in this process.
+        uint64_t id() const noexcept { return serial; }
+
+    private:
+        std::array<uint8_t, 32> sign(Scheme scheme, const std::string& payload) const;
+
+        friend class IdentitySigner;
+        crypto_small::HmacSha256 mac;
+        crypto_small::Blake2sMac blake;
+        uint64_t serial;
+    };
+
+    // Signs one customer for any number of dates. The normalised
+    // "first|last|email|Vn|" prefix is absorbed into each prepared scheme's
+    // MAC once, so a further date only costs the blocks holding the date
+    // (plus the outer hash for V1). The first constructor prepares both
+    // schemes; the second only those listed, and a scheme left out still
+    // signs and verifies, but absorbs the prefix again on every call.
+    class IdentitySigner
+    {
+    public:
+        IdentitySigner(const std::string& first,
+                       const std::string& last,
+                       const std::string& email,
+                       const SigningKey& key = SigningKey::builtIn());
+
+        IdentitySigner(const std::string& first,
+                       const std::string& last,
+                       const std::string& email,
+                       std::initializer_list<Scheme> schemes,
+                       const SigningKey& key = SigningKey::builtIn());
+
+        std::string makeLicense(const std::string& yyyymmdd, Scheme scheme = kIssueScheme) const;
+
+        bool verifyLicense(const std::string& licenseStr) const;
+
+        // The same, without going through text. An invalid yyyymmdd gives an empty key.
+        PackedLicense makePacked(const std::string& yyyymmdd, Scheme scheme = kIssueScheme) const;
+        bool verifyLicense(const PackedLicense& key) const;
+
+        // Equal for every spelling of the same customer that verifies alike.
+        const std::string& identity() const noexcept { return prefix; }
+
+    private:
+        std::array<uint8_t, 32> sign(Scheme scheme, const std::string& yyyymmdd) const;
+
+        std::string prefix;
+        std::string v2Prefix;
+        crypto_small::HmacSha256 midstate;
+        crypto_small::Blake2sMac blakeMidstate;
+        bool v1Prepared = false;
+        bool v2Prepared = false;
+    };
 } // namespace license
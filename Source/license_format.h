@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+/*
+    The textual layout of a license key, fixed at compile time.
+
+    LicenseFormat<VersionChars, SigChars, GroupSize> describes keys shaped
+    like VERSION-YYYYMMDD-XXXX-XXXX-XXXX: a VersionChars-long version tag,
+    the date, and SigChars Base32 signature characters in dash-separated
+    groups of GroupSize. The length, every separator offset and the number
+    of signature bits are constants, and format / parse are unrolled over
+    index sequences, so nothing is split or measured at run time.
+
+    Today's keys are StandardFormat. A longer signature for a higher-value
+    product is one more alias, e.g. LicenseFormat<2, 20, 5>.
+*/
+namespace license
+{
+    inline constexpr char kBase32Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+    template <size_t VersionChars, size_t SigChars, size_t GroupSize>
+    struct LicenseFormat
+    {
+        static_assert(VersionChars > 0 && GroupSize > 0 && SigChars % GroupSize == 0,
+                      "the signature must split into whole groups");
+        static_assert(SigChars * 5 <= 256, "the signature is cut from a 256-bit digest");
+
+        static constexpr size_t versionChars = VersionChars;
+        static constexpr size_t dateChars = 8;
+        static constexpr size_t signatureChars = SigChars;
+        static constexpr size_t groupSize = GroupSize;
+        static constexpr size_t groups = SigChars / GroupSize;
+        static constexpr size_t signatureBits = SigChars * 5;
+
+        static constexpr size_t dateOffset = VersionChars + 1;
+        static constexpr size_t signatureOffset = dateOffset + dateChars + 1;
+        static constexpr size_t length = signatureOffset + SigChars + groups - 1;
+
+        using Text = std::array<char, length>;
+        using Signature = std::array<char, SigChars>;
+        using Digest = std::array<uint8_t, 32>;
+
+        // Where signature character i sits in the text.
+        static constexpr size_t signaturePos(size_t i) noexcept
+        {
+            return signatureOffset + i + i / GroupSize;
+        }
+
+        // The first SigChars Base32 characters of digest, most significant bits first.
+        static Signature signatureOf(const Digest& digest) noexcept
+        {
+            return signatureOf(digest, std::make_index_sequence<SigChars>{});
+        }
+
+        // Writes exactly `length` characters. version must hold VersionChars
+        // characters and date eight.
+        static void format(char* out, const char* version, const char* date, const Digest& digest) noexcept
+        {
+            format(out, version, date, signatureOf(digest));
+        }
+
+        static void format(char* out, const char* version, const char* date, const Signature& signature) noexcept
+        {
+            copy<0>(out, version, std::make_index_sequence<VersionChars>{});
+            out[VersionChars] = '-';
+            copy<dateOffset>(out, date, std::make_index_sequence<dateChars>{});
+            out[dateOffset + dateChars] = '-';
+            writeGroupSeparators(out, std::make_index_sequence<groups - 1>{});
+            writeSignature(out, signature, std::make_index_sequence<SigChars>{});
+        }
+
+        // Canonicalises text into out: whitespace anywhere is dropped and
+        // letters are upper-cased. Returns false unless the result has the
+        // separators in place, an all-digit date and a Base32 signature.
+        static bool parse(std::string_view text, Text& out) noexcept
+        {
+            size_t n = 0;
+            for (const char c : text)
+            {
+                if (c == ' ' || (c >= '\t' && c <= '\r'))
+                    continue;
+                if (n == length)
+                    return false;
+                out[n++] = (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+            }
+
+            return n == length
+                && out[VersionChars] == '-' && out[dateOffset + dateChars] == '-'
+                && groupSeparatorsOk(out, std::make_index_sequence<groups - 1>{})
+                && dateOk(out, std::make_index_sequence<dateChars>{})
+                && signatureCharsOk(out, std::make_index_sequence<SigChars>{});
+        }
+
+        static std::string_view version(const Text& text) noexcept { return { text.data(), VersionChars }; }
+        static std::string_view date(const Text& text) noexcept { return { text.data() + dateOffset, dateChars }; }
+
+        static Signature signature(const Text& text) noexcept
+        {
+            return gatherSignature(text, std::make_index_sequence<SigChars>{});
+        }
+
+        // Constant time: every character is compared whatever the first mismatch.
+        static bool signaturesMatch(const Signature& a, const Signature& b) noexcept
+        {
+            return difference(a, b, std::make_index_sequence<SigChars>{}) == 0;
+        }
+
+    private:
+        template <size_t I>
+        static char signatureChar(const Digest& digest) noexcept
+        {
+            constexpr size_t bit = I * 5;
+            constexpr size_t byte = bit / 8;
+            unsigned window = static_cast<unsigned>(digest[byte]) << 8;
+            if constexpr (byte + 1 < 32)
+                window |= digest[byte + 1];
+            return kBase32Alphabet[(window >> (11 - bit % 8)) & 0x1fu];
+        }
+
+        static constexpr bool isBase32(char c) noexcept
+        {
+            return (c >= 'A' && c <= 'Z') || (c >= '2' && c <= '7');
+        }
+
+        template <size_t... I>
+        static Signature signatureOf(const Digest& digest, std::index_sequence<I...>) noexcept
+        {
+            return { signatureChar<I>(digest)... };
+        }
+
+        template <size_t Offset, size_t... I>
+        static void copy(char* out, const char* in, std::index_sequence<I...>) noexcept
+        {
+            ((out[Offset + I] = in[I]), ...);
+        }
+
+        template <size_t... G>
+        static void writeGroupSeparators(char* out, std::index_sequence<G...>) noexcept
+        {
+            ((out[signaturePos((G + 1) * GroupSize) - 1] = '-'), ...);
+        }
+
+        template <size_t... I>
+        static void writeSignature(char* out, const Signature& signature, std::index_sequence<I...>) noexcept
+        {
+            ((out[signaturePos(I)] = signature[I]), ...);
+        }
+
+        template <size_t... G>
+        static bool groupSeparatorsOk(const Text& text, std::index_sequence<G...>) noexcept
+        {
+            return ((text[signaturePos((G + 1) * GroupSize) - 1] == '-') && ...);
+        }
+
+        template <size_t... I>
+        static bool dateOk(const Text& text, std::index_sequence<I...>) noexcept
+        {
+            return ((text[dateOffset + I] >= '0' && text[dateOffset + I] <= '9') && ...);
+        }
+
+        template <size_t... I>
+        static bool signatureCharsOk(const Text& text, std::index_sequence<I...>) noexcept
+        {
+            return (isBase32(text[signaturePos(I)]) && ...);
+        }
+
+        template <size_t... I>
+        static Signature gatherSignature(const Text& text, std::index_sequence<I...>) noexcept
+        {
+            return { text[signaturePos(I)]... };
+        }
+
+        template <size_t... I>
+        static unsigned difference(const Signature& a, const Signature& b, std::index_sequence<I...>) noexcept
+        {
+            return (0u | ... | static_cast<unsigned>(static_cast<unsigned char>(a[I] ^ b[I])));
+        }
+    };
+
+    // V1-YYYYMMDD-XXXX-XXXX-XXXX and V2-..., 60 signature bits.
+    using StandardFormat = LicenseFormat<2, 12, 4>;
+
+    static_assert(StandardFormat::length == 26 && StandardFormat::signatureBits == 60);
+} // namespace license
@@ -0,0 +1,457 @@
+#include "loadtest.h"
+#include "batch.h"
+#include "license.h"
+#include "metrics.h"
+#include "sinks.h"
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace loadtest
+{
+    namespace
+    {
+        // splitmix64: tiny, fast and identical on every platform, unlike the
+        // standard library's distributions.
+        class Rng
+        {
+        public:
+            explicit Rng(uint64_t seed) : state(seed) {}
+
+            uint64_t next() noexcept
+            {
+                uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                return z ^ (z >> 31);
+            }
+
+            size_t below(size_t n) noexcept { return static_cast<size_t>(next() % n); }
+            double unit() noexcept { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+            bool chance(double p) noexcept { return unit() < p; }
+
+        private:
+            uint64_t state;
+        };
+
+        // UTF-8 spelled out so the source stays ASCII.
+        const char* const firstNames[] =
+        {
+            "Ada", "Steve", "Mary Ann", "John   Paul", "Test", "Grace", "Linus", "Margaret",
+            "Jos\xc3\xa9", "Zo\xc3\xab", "\xc5\x81ukasz", "S\xc3\xb8ren", "Ana Mar\xc3\xad" "a", "Fran\xc3\xa7ois",
+            "\xc3\x85sa", "Nguy\xe1\xbb\x85n", "\xd0\x98\xd0\xb2\xd0\xb0\xd0\xbd", "\xe7\xbe\x8e\xe5\x92\xb2"
+        };
+
+        const char* const lastNames[] =
+        {
+            "Leach", "Lovelace", "ONeil", "O'Brien", "Van   Damme", "Hopper", "Torvalds", "Hamilton",
+            "Garc\xc3\xad" "a", "M\xc3\xbcller", "Kowalski", "\xc3\x98stergaard", "Le Gu\xc3\xaf" "n",
+            "\xd0\x9f\xd0\xb5\xd1\x82\xd1\x80\xd0\xbe\xd0\xb2", "\xe5\xb1\xb1\xe7\x94\xb0", "de la Cruz"
+        };
+
+        const char* const domains[] =
+        {
+            "example.com", "gmail.com", "example.co", "outlook.com", "yahoo.co.uk", "mail.example.org"
+        };
+
+        template <typename T, size_t N>
+        const T& pick(Rng& rng, const T (&items)[N]) { return items[rng.below(N)]; }
+
+        std::string asciiLocalPart(const std::string& first, const std::string& last, uint64_t serial)
+        {
+            std::string out;
+            for (char c : first + "." + last)
+            {
+                const auto uc = static_cast<unsigned char>(c);
+                if ((uc >= 'a' && uc <= 'z') || (uc >= '0' && uc <= '9') || uc == '.')
+                    out.push_back(c);
+                else if (uc >= 'A' && uc <= 'Z')
+                    out.push_back(static_cast<char>(uc - 'A' + 'a'));
+            }
+            if (out.empty() || out == ".")
+                out = "customer";
+            return out + std::to_string(serial);
+        }
+
+        std::string padded(Rng& rng, const std::string& field)
+        {
+            if (! rng.chance(0.1))
+                return field;
+            return std::string(1 + rng.below(3), ' ') + field + std::string(rng.below(3), ' ');
+        }
+
+        std::string malformedLine(Rng& rng)
+        {
+            switch (rng.below(4))
+            {
+                case 0:  return "OnlyTwo,Fields";
+                case 1:  return ",Missing,first@example.com";
+                case 2:  return "";
+                default: return "###garbage###";
+            }
+        }
+
+        juce::String optionValue(const juce::StringArray& args, const juce::String& name, const juce::String& fallback = {})
+        {
+            for (const auto& arg : args)
+                if (arg.startsWith(name + "="))
+                    return arg.fromFirstOccurrenceOf("=", false, false);
+            return fallback;
+        }
+
+        struct StageResult
+        {
+            juce::String name;
+            juce::int64 rows = 0;
+            double seconds = 0.0;
+            metrics::Snapshot snapshot;
+
+            double rowsPerSecond() const { return seconds > 0.0 ? static_cast<double>(rows) / seconds : 0.0; }
+        };
+
+        template <typename Fn>
+        StageResult timeStage(const juce::String& name, Fn&& fn)
+        {
+            const metrics::Interval interval;
+            StageResult result;
+            result.name = name;
+            const auto start = juce::Time::getHighResolutionTicks();
+            result.rows = fn();
+            result.seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            result.snapshot = interval.snapshot();
+            return result;
+        }
+
+        // first \t last \t email per line, as generateDataset wrote them.
+        std::vector<juce::StringArray> loadExpectedRows(const juce::File& file)
+        {
+            juce::StringArray lines;
+            file.readLines(lines);
+
+            std::vector<juce::StringArray> rows;
+            rows.reserve(static_cast<size_t>(lines.size()));
+            for (const auto& line : lines)
+                if (line.isNotEmpty())
+                    rows.push_back(juce::StringArray::fromTokens(line, "\t", ""));
+            return rows;
+        }
+
+        juce::var toVar(const std::vector<StageResult>& stages, juce::int64 inputRows)
+        {
+            auto* root = new juce::DynamicObject();
+            root->setProperty("input_rows", inputRows);
+            root->setProperty("peak_rss_bytes", static_cast<juce::int64>(metrics::peakResidentMemoryBytes()));
+
+            auto* stageObj = new juce::DynamicObject();
+            for (const auto& st : stages)
+            {
+                auto* obj = new juce::DynamicObject();
+                obj->setProperty("rows", st.rows);
+                obj->setProperty("seconds", st.seconds);
+                obj->setProperty("rows_per_s", st.rowsPerSecond());
+
+                for (size_t s = 0; s < metrics::kNumStages; ++s)
+                {
+                    const auto& m = st.snapshot.stages[s];
+                    if (m.count == 0)
+                        continue;
+
+                    auto* lat = new juce::DynamicObject();
+                    lat->setProperty("p50_ns", static_cast<juce::int64>(m.p50Nanos));
+                    lat->setProperty("p99_ns", static_cast<juce::int64>(m.p99Nanos));
+                    lat->setProperty("p999_ns", static_cast<juce::int64>(m.p999Nanos));
+                    obj->setProperty(metrics::stageName(static_cast<metrics::Stage>(s)), juce::var(lat));
+                }
+
+                stageObj->setProperty(st.name, juce::var(obj));
+            }
+
+            root->setProperty("stages", juce::var(stageObj));
+            return juce::var(root);
+        }
+
+        juce::String describe(const std::vector<StageResult>& stages)
+        {
+            juce::String text;
+            for (const auto& st : stages)
+            {
+                text << st.name.paddedRight(' ', 10)
+                     << juce::String(st.rows).paddedLeft(' ', 12) << " rows "
+                     << juce::String(st.seconds, 3).paddedLeft(' ', 10) << " s "
+                     << juce::String(st.rowsPerSecond(), 0).paddedLeft(' ', 12) << " rows/s\n";
+
+                for (size_t s = 0; s < metrics::kNumStages; ++s)
+                {
+                    const auto& m = st.snapshot.stages[s];
+                    if (m.count == 0)
+                        continue;
+
+                    text << "    " << juce::String(metrics::stageName(static_cast<metrics::Stage>(s))).paddedRight(' ', 18)
+                         << "p50 " << juce::String(static_cast<juce::int64>(m.p50Nanos)) << " ns  "
+                         << "p99 " << juce::String(static_cast<juce::int64>(m.p99Nanos)) << " ns  "
+                         << "p999 " << juce::String(static_cast<juce::int64>(m.p999Nanos)) << " ns\n";
+                }
+            }
+
+            text << "peak RSS " << juce::File::descriptionOfSizeInBytes(static_cast<juce::int64>(metrics::peakResidentMemoryBytes()));
+            return text;
+        }
+
+        // Returns the stages that got slower than baseline by more than threshold.
+        juce::StringArray regressions(const std::vector<StageResult>& stages, const juce::var& baseline, double threshold)
+        {
+            juce::StringArray slower;
+            for (const auto& st : stages)
+            {
+                const double before = baseline["stages"][juce::Identifier(st.name)]["rows_per_s"];
+                if (before <= 0.0)
+                    continue;
+
+                const double now = st.rowsPerSecond();
+                if (now < before * (1.0 - threshold))
+                    slower.add(st.name + ": " + juce::String(now, 0) + " rows/s vs baseline " + juce::String(before, 0));
+            }
+            return slower;
+        }
+
+        commands::Result runLoadTest(const juce::StringArray& args, int index, const juce::File& cwd)
+        {
+            if (args.size() < index + 2)
+                return { 1, "usage: --loadtest <in.csv> [--baseline=<file>] [--write-baseline] [--threshold=0.15]" };
+
+            const auto input = cwd.getChildFile(args[index + 1]);
+            if (! input.existsAsFile())
+                return { 1, "input not found: " + input.getFullPathName() };
+
+            const auto output = input.getSiblingFile(input.getFileNameWithoutExtension() + ".loadtest-out.csv");
+            const auto expectedFile = expectedRowsFile(input);
+            std::vector<batch::Row> rows;
+            juce::int64 inputLines = 0;
+            juce::int64 auditFailures = 0;
+            std::vector<StageResult> stages;
+
+            juce::String content;
+            stages.push_back(timeStage("issue", [&]
+            {
+                content = input.loadFileAsString();
+                rows = batch::issueFromCsv(content);
+                return static_cast<juce::int64>(rows.size());
+            }));
+
+            inputLines = static_cast<juce::int64>(juce::StringArray::fromLines(content).size());
+            content.clear();
+
+            stages.push_back(timeStage("save", [&]
+            {
+                return sinks::writeAll(output, rows).wasOk() ? static_cast<juce::int64>(rows.size()) : juce::int64(0);
+            }));
+
+            // Saved rows against what the generator meant, not against a
+            // re-parse of the input, so a parser that splits a field wrongly
+            // shows up here.
+            const bool audited = expectedFile.existsAsFile();
+            if (audited)
+            {
+                const auto expected = loadExpectedRows(expectedFile);
+
+                stages.push_back(timeStage("audit", [&]
+                {
+                    juce::StringArray lines;
+                    output.readLines(lines);
+
+                    size_t next = 0;
+                    for (int i = 1; i < lines.size(); ++i)
+                    {
+                        if (lines[i].isEmpty())
+                            continue;
+
+                        const auto columns = batch::splitCsvLine(lines[i]);
+                        const auto* want = next < expected.size() ? &expected[next] : nullptr;
+                        ++next;
+
+                        if (want == nullptr || want->size() != 3 || columns.size() != 4
+                            || columns[0] != (*want)[0] || columns[1] != (*want)[1] || columns[2] != (*want)[2]
+                            || ! license::verifyLicense(columns[3].toStdString(), (*want)[0].toStdString(),
+                                                        (*want)[1].toStdString(), (*want)[2].toStdString()))
+                            ++auditFailures;
+                    }
+
+                    // Rows the generator meant but the save never produced.
+                    if (next < expected.size())
+                        auditFailures += static_cast<juce::int64>(expected.size() - next);
+
+                    return static_cast<juce::int64>(next);
+                }));
+            }
+
+            output.deleteFile();
+
+            // The same rows signed under each scheme, so the report compares them.
+            for (const auto scheme : { license::Scheme::v1, license::Scheme::v2 })
+            {
+                const auto& key = license::SigningKey::builtIn();
+                std::vector<std::string> keys;
+                keys.reserve(rows.size());
+                for (const auto& row : rows)
+                    keys.push_back(key.makeLicense(row.first.toStdString(), row.last.toStdString(),
+                                                   row.email.toStdString(), "20300101", scheme));
+
+                const auto name = scheme == license::Scheme::v1 ? "verify-v1" : "verify-v2";
+                stages.push_back(timeStage(name, [&]
+                {
+                    for (size_t i = 0; i < rows.size(); ++i)
+                        if (! key.verifyLicense(keys[i], rows[i].first.toStdString(),
+                                                rows[i].last.toStdString(), rows[i].email.toStdString()))
+                            ++auditFailures;
+                    return static_cast<juce::int64>(rows.size());
+                }));
+            }
+
+            const auto report = toVar(stages, inputLines);
+            juce::String text = describe(stages);
+            if (audited)
+                text << "\naudit failures " << auditFailures << " (saved rows that differ from the generated ones or do not verify)";
+            else
+                text << "\naudit skipped: no " << expectedFile.getFileName();
+
+            const auto baselinePath = optionValue(args, "--baseline");
+            if (baselinePath.isEmpty())
+                return { 0, text + "\n" + juce::JSON::toString(report, true) };
+
+            const auto baselineFile = cwd.getChildFile(baselinePath);
+            if (args.contains("--write-baseline"))
+            {
+                if (! baselineFile.replaceWithText(juce::JSON::toString(report)))
+                    return { 1, text + "\nfailed to write baseline " + baselineFile.getFullPathName() };
+                return { 0, text + "\nbaseline written to " + baselineFile.getFullPathName() };
+            }
+
+            const auto baseline = juce::JSON::parse(baselineFile);
+            if (! baseline.isObject())
+                return { 1, text + "\nno usable baseline at " + baselineFile.getFullPathName() };
+
+            const double threshold = optionValue(args, "--threshold", "0.15").getDoubleValue();
+            const auto slower = regressions(stages, baseline, threshold);
+            if (! slower.isEmpty())
+                return { 3, text + "\nREGRESSION\n" + slower.joinIntoString("\n") };
+
+            return { 0, text + "\nwithin " + juce::String(threshold * 100.0, 0) + "% of baseline" };
+        }
+    }
+
+    juce::File expectedRowsFile(const juce::File& dataset)
+    {
+        return dataset.getSiblingFile(dataset.getFileName() + ".expected.tsv");
+    }
+
+    juce::Result generateDataset(const juce::File& output, const DatasetOptions& options)
+    {
+        const auto expectedFile = expectedRowsFile(output);
+        output.deleteFile();
+        expectedFile.deleteFile();
+
+        juce::FileOutputStream out(output, 1 << 20);
+        juce::FileOutputStream expectedOut(expectedFile, 1 << 20);
+        if (! out.openedOk())
+            return juce::Result::fail("failed to write " + output.getFullPathName());
+        if (! expectedOut.openedOk())
+            return juce::Result::fail("failed to write " + expectedFile.getFullPathName());
+
+        Rng rng(options.seed);
+        std::vector<std::pair<std::string, std::string>> recent;   // (line, expected row)
+        recent.reserve(1024);
+        std::string line;
+        std::string expected;
+
+        out << "first,last,email\n";
+
+        for (juce::int64 i = 0; i < options.rows; ++i)
+        {
+            expected.clear();
+
+            if (rng.chance(options.malformedRate))
+            {
+                line = malformedLine(rng);
+            }
+            else if (! recent.empty() && rng.chance(options.duplicateRate))
+            {
+                std::tie(line, expected) = recent[rng.below(recent.size())];
+            }
+            else
+            {
+                const std::string first = pick(rng, firstNames);
+                std::string last = pick(rng, lastNames);
+                const std::string email = asciiLocalPart(first, last, static_cast<uint64_t>(i))
+                                        + (rng.chance(0.05) ? "+tag" : "") + "@" + pick(rng, domains);
+
+                // Stray whitespace goes inside the quotes, as RFC 4180 expects.
+                std::string lastField;
+                if (rng.chance(options.quotedRate))
+                {
+                    last += ", Jr.";
+                    lastField = "\"" + padded(rng, last) + "\"";
+                }
+                else
+                {
+                    lastField = padded(rng, last);
+                }
+
+                line = padded(rng, first) + "," + lastField + "," + padded(rng, email);
+                expected = first + "\t" + last + "\t" + email;
+
+                if (recent.size() < 1024)
+                    recent.emplace_back(line, expected);
+                else
+                    recent[rng.below(recent.size())] = { line, expected };
+            }
+
+            line.push_back('\n');
+            if (! out.write(line.data(), line.size()))
+                return juce::Result::fail("failed to write " + output.getFullPathName());
+
+            if (! expected.empty())
+            {
+                expected.push_back('\n');
+                if (! expectedOut.write(expected.data(), expected.size()))
+                    return juce::Result::fail("failed to write " + expectedFile.getFullPathName());
+            }
+        }
+
+        out.flush();
+        expectedOut.flush();
+        if (out.getStatus().failed())
+            return out.getStatus();
+        return expectedOut.getStatus();
+    }
+
+    bool handles(const juce::StringArray& args)
+    {
+        return args.contains("--gen-dataset") || args.contains("--loadtest");
+    }
+
+    commands::Result run(const juce::StringArray& args, const juce::File& cwd)
+    {
+        if (const int i = args.indexOf("--gen-dataset"); i >= 0)
+        {
+            if (args.size() < i + 3)
+                return { 1, "usage: --gen-dataset <out.csv> <rows> [--seed=N] [--dup-rate=R] [--malformed-rate=R] [--quoted-rate=R]" };
+
+            DatasetOptions options;
+            options.rows = args[i + 2].getLargeIntValue();
+            options.seed = static_cast<uint64_t>(optionValue(args, "--seed", "1").getLargeIntValue());
+            options.duplicateRate = optionValue(args, "--dup-rate", juce::String(options.duplicateRate)).getDoubleValue();
+            options.malformedRate = optionValue(args, "--malformed-rate", juce::String(options.malformedRate)).getDoubleValue();
+            options.quotedRate = optionValue(args, "--quoted-rate", juce::String(options.quotedRate)).getDoubleValue();
+
+            const auto output = cwd.getChildFile(args[i + 1]);
+            const auto r = generateDataset(output, options);
+            if (r.failed())
+                return { 1, r.getErrorMessage() };
+            return { 0, juce::String(options.rows) + " rows written to " + output.getFullPathName() };
+        }
+
+        return runLoadTest(args, args.indexOf("--loadtest"), cwd);
+    }
+} // namespace loadtest
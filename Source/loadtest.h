@@ -0,0 +1,46 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+
+/*
+    End-to-end load testing.
+
+        --gen-dataset <out.csv> <rows> [--seed=N] [--dup-rate=R]
+                      [--malformed-rate=R] [--quoted-rate=R]
+        --loadtest <in.csv> [--baseline=<file>] [--write-baseline]
+                   [--threshold=0.15]
+
+    The generator is deterministic for a given seed on every platform: it
+    produces Unicode names, stray whitespace like users_test.csv, quoted
+    fields containing commas, duplicate customers and malformed lines at the
+    requested rates. Next to the dataset it writes <out>.expected.tsv, the
+    first/last/email every valid line stands for. The load test drives
+    issue -> save -> audit over a dataset, where audit checks the saved rows
+    against that file (it is skipped without one), then verifies the same
+    rows as V1 and as V2 keys, and reports rows/s, peak RSS and latency
+    percentiles per stage. Stages are measured with metrics::Interval, so a
+    load test inside a running instance leaves its metrics alone.
+    With --baseline it compares against a previous run and fails (exit code
+    3) when any stage's throughput drops by more than the threshold;
+    --write-baseline stores this run as the new baseline instead.
+*/
+namespace loadtest
+{
+    struct DatasetOptions
+    {
+        juce::int64 rows = 100000;
+        uint64_t seed = 1;
+        double duplicateRate = 0.01;
+        double malformedRate = 0.005;
+        double quotedRate = 0.01;
+    };
+
+    juce::Result generateDataset(const juce::File& output, const DatasetOptions& options);
+
+    // Where generateDataset puts the rows a dataset is meant to parse into.
+    juce::File expectedRowsFile(const juce::File& dataset);
+
+    bool handles(const juce::StringArray& args);
+    commands::Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+} // namespace loadtest
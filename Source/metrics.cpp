@@ -0,0 +1,337 @@
+#include "metrics.h"
+
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+
+#if defined(_WIN32)
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+ #include <psapi.h>
+ #pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+ #include <mach/mach.h>
+ #include <sys/resource.h>
+#else
+ #include <sys/resource.h>
+ #include <unistd.h>
+#endif
+
+namespace metrics
+{
+    namespace
+    {
+        constexpr size_t kShards = 16;
+        constexpr size_t kSubBits = 3;
+        constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+        constexpr size_t kLinearLimit = kSubBuckets * 2;  // values below this get exact buckets
+        constexpr size_t kMaxExponent = 47;              // ~39 hours in nanoseconds
+        constexpr size_t kBuckets = kLinearLimit + (kMaxExponent - kSubBits) * kSubBuckets;
+
+        struct alignas(64) Shard
+        {
+            std::array<std::array<std::atomic<uint64_t>, kBuckets>, kNumStages> buckets{};
+            std::array<std::atomic<uint64_t>, kNumStages> totals{};
+            std::atomic<uint64_t> rows{ 0 };
+            std::atomic<uint64_t> cacheHits{ 0 };
+            std::atomic<uint64_t> cacheMisses{ 0 };
+        };
+
+        Shard shards[kShards];
+        std::atomic<size_t> nextShard{ 0 };
+        std::atomic<uint64_t> queuedInteractive{ 0 };
+        std::atomic<uint64_t> queuedBulk{ 0 };
+        const auto startTime = std::chrono::steady_clock::now();
+
+        Shard& localShard() noexcept
+        {
+            thread_local const size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+            return shards[index];
+        }
+
+        size_t floorLog2(uint64_t v) noexcept
+        {
+            size_t r = 0;
+            while (v >>= 1)
+                ++r;
+            return r;
+        }
+
+        size_t bucketFor(uint64_t nanos) noexcept
+        {
+            if (nanos < kLinearLimit)
+                return static_cast<size_t>(nanos);
+
+            size_t exponent = floorLog2(nanos);
+            if (exponent > kMaxExponent)
+                return kBuckets - 1;
+
+            const size_t sub = static_cast<size_t>(nanos >> (exponent - kSubBits)) & (kSubBuckets - 1);
+            return kLinearLimit + (exponent - kSubBits - 1) * kSubBuckets + sub;
+        }
+
+        // Midpoint of the bucket's value range, which is what percentiles report.
+        uint64_t bucketValue(size_t index) noexcept
+        {
+            if (index < kLinearLimit)
+                return index;
+
+            const size_t rel = index - kLinearLimit;
+            const size_t exponent = rel / kSubBuckets + kSubBits + 1;
+            const uint64_t sub = rel % kSubBuckets;
+            const uint64_t width = uint64_t(1) << (exponent - kSubBits);
+            const uint64_t low = (uint64_t(1) << exponent) + sub * width;
+            return low + width / 2;
+        }
+
+        uint64_t percentile(const std::array<uint64_t, kBuckets>& counts, uint64_t total, double q) noexcept
+        {
+            if (total == 0)
+                return 0;
+
+            const auto rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i)
+            {
+                seen += counts[i];
+                if (seen >= rank)
+                    return bucketValue(i);
+            }
+            return bucketValue(kBuckets - 1);
+        }
+    }
+
+    const char* stageName(Stage stage) noexcept
+    {
+        switch (stage)
+        {
+            case Stage::normalize:        return "normalize";
+            case Stage::hmac:             return "hmac";
+            case Stage::blake2s:          return "blake2s";
+            case Stage::encode:           return "encode";
+            case Stage::verify:           return "verify";
+            case Stage::csvParse:         return "csv_parse";
+            case Stage::ledgerWrite:      return "ledger_write";
+            case Stage::queueInteractive: return "queue_interactive";
+            case Stage::queueBulk:        return "queue_bulk";
+            case Stage::count:            break;
+        }
+        return "unknown";
+    }
+
+    void record(Stage stage, uint64_t nanos) noexcept
+    {
+        auto& shard = localShard();
+        const auto s = static_cast<size_t>(stage);
+        shard.buckets[s][bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+        shard.totals[s].fetch_add(nanos, std::memory_order_relaxed);
+    }
+
+    void addRows(uint64_t rows) noexcept
+    {
+        localShard().rows.fetch_add(rows, std::memory_order_relaxed);
+    }
+
+    void addCacheLookup(bool hit) noexcept
+    {
+        auto& shard = localShard();
+        (hit ? shard.cacheHits : shard.cacheMisses).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void setQueueDepths(uint64_t interactive, uint64_t bulk) noexcept
+    {
+        queuedInteractive.store(interactive, std::memory_order_relaxed);
+        queuedBulk.store(bulk, std::memory_order_relaxed);
+    }
+
+    namespace
+    {
+        struct Totals
+        {
+            std::array<std::array<uint64_t, kBuckets>, kNumStages> buckets{};
+            std::array<uint64_t, kNumStages> nanos{};
+            uint64_t rows = 0;
+            uint64_t cacheHits = 0;
+            uint64_t cacheMisses = 0;
+        };
+
+        void sumShards(Totals& t) noexcept
+        {
+            for (auto& shard : shards)
+            {
+                for (size_t s = 0; s < kNumStages; ++s)
+                {
+                    for (size_t b = 0; b < kBuckets; ++b)
+                        t.buckets[s][b] += shard.buckets[s][b].load(std::memory_order_relaxed);
+                    t.nanos[s] += shard.totals[s].load(std::memory_order_relaxed);
+                }
+
+                t.rows += shard.rows.load(std::memory_order_relaxed);
+                t.cacheHits += shard.cacheHits.load(std::memory_order_relaxed);
+                t.cacheMisses += shard.cacheMisses.load(std::memory_order_relaxed);
+            }
+        }
+
+        // A reset() since the baseline was taken clamps to zero rather than wrapping.
+        uint64_t since(uint64_t now, uint64_t then) noexcept
+        {
+            return now > then ? now - then : 0;
+        }
+
+        Snapshot summarise(const Totals& t)
+        {
+            Snapshot snap;
+
+            for (size_t s = 0; s < kNumStages; ++s)
+            {
+                uint64_t total = 0;
+                for (const auto c : t.buckets[s])
+                    total += c;
+
+                auto& out = snap.stages[s];
+                out.count = total;
+                out.totalNanos = t.nanos[s];
+                out.p50Nanos = percentile(t.buckets[s], total, 0.50);
+                out.p99Nanos = percentile(t.buckets[s], total, 0.99);
+                out.p999Nanos = percentile(t.buckets[s], total, 0.999);
+            }
+
+            snap.rows = t.rows;
+            snap.cacheHits = t.cacheHits;
+            snap.cacheMisses = t.cacheMisses;
+            snap.queuedInteractive = queuedInteractive.load(std::memory_order_relaxed);
+            snap.queuedBulk = queuedBulk.load(std::memory_order_relaxed);
+            snap.residentBytes = residentMemoryBytes();
+            snap.uptimeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            return snap;
+        }
+    }
+
+    Snapshot snapshot()
+    {
+        auto totals = std::make_unique<Totals>();
+        sumShards(*totals);
+        return summarise(*totals);
+    }
+
+    struct Interval::Baseline
+    {
+        Totals totals;
+    };
+
+    Interval::Interval() : baseline(std::make_unique<Baseline>())
+    {
+        sumShards(baseline->totals);
+    }
+
+    Interval::~Interval() = default;
+
+    Snapshot Interval::snapshot() const
+    {
+        auto now = std::make_unique<Totals>();
+        sumShards(*now);
+
+        const auto& then = baseline->totals;
+        for (size_t s = 0; s < kNumStages; ++s)
+        {
+            for (size_t b = 0; b < kBuckets; ++b)
+                now->buckets[s][b] = since(now->buckets[s][b], then.buckets[s][b]);
+            now->nanos[s] = since(now->nanos[s], then.nanos[s]);
+        }
+        now->rows = since(now->rows, then.rows);
+        now->cacheHits = since(now->cacheHits, then.cacheHits);
+        now->cacheMisses = since(now->cacheMisses, then.cacheMisses);
+
+        return summarise(*now);
+    }
+
+    void reset() noexcept
+    {
+        for (auto& shard : shards)
+        {
+            for (auto& stage : shard.buckets)
+                for (auto& bucket : stage)
+                    bucket.store(0, std::memory_order_relaxed);
+            for (auto& total : shard.totals)
+                total.store(0, std::memory_order_relaxed);
+            shard.rows.store(0, std::memory_order_relaxed);
+            shard.cacheHits.store(0, std::memory_order_relaxed);
+            shard.cacheMisses.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t residentMemoryBytes() noexcept
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+            return static_cast<uint64_t>(pmc.WorkingSetSize);
+        return 0;
+#elif defined(__APPLE__)
+        mach_task_basic_info info{};
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+            return static_cast<uint64_t>(info.resident_size);
+        return 0;
+#else
+        FILE* f = std::fopen("/proc/self/statm", "r");
+        if (f == nullptr)
+            return 0;
+        unsigned long long pages = 0, resident = 0;
+        const int n = std::fscanf(f, "%llu %llu", &pages, &resident);
+        std::fclose(f);
+        if (n != 2)
+            return 0;
+        return static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    uint64_t peakResidentMemoryBytes() noexcept
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+            return static_cast<uint64_t>(pmc.PeakWorkingSetSize);
+        return 0;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+ #if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss);          // bytes on macOS
+ #else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024u;  // kilobytes on Linux
+ #endif
+#endif
+    }
+
+    std::string toJson(const Snapshot& snap)
+    {
+        std::ostringstream oss;
+        oss << "{\"uptime_s\":" << snap.uptimeSeconds
+            << ",\"rows\":" << snap.rows
+            << ",\"verify_cache\":{\"hits\":" << snap.cacheHits << ",\"misses\":" << snap.cacheMisses << '}'
+            << ",\"queued\":{\"interactive\":" << snap.queuedInteractive << ",\"bulk\":" << snap.queuedBulk << '}'
+            << ",\"resident_bytes\":" << snap.residentBytes
+            << ",\"stages\":{";
+
+        for (size_t s = 0; s < kNumStages; ++s)
+        {
+            const auto& st = snap.stages[s];
+            if (s != 0)
+                oss << ',';
+            oss << '"' << stageName(static_cast<Stage>(s)) << "\":{"
+                << "\"count\":" << st.count
+                << ",\"total_ns\":" << st.totalNanos
+                << ",\"p50_ns\":" << st.p50Nanos
+                << ",\"p99_ns\":" << st.p99Nanos
+                << ",\"p999_ns\":" << st.p999Nanos
+                << '}';
+        }
+
+        oss << "}}";
+        return oss.str();
+    }
+} // namespace metrics
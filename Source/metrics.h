@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+    Process-wide performance counters.
+
+    Every recording thread writes into its own shard of relaxed atomics, so the
+    hot paths never contend on a shared cache line or take a lock. Latencies go
+    into fixed log-linear histograms (8 sub-buckets per power of two), which
+    keeps percentile error under ~12% without any allocation. snapshot() sums
+    the shards on demand for the UI panel or a JSON dump.
+*/
+namespace metrics
+{
+    enum class Stage : int
+    {
+        normalize = 0,
+        hmac,               // V1 signatures (HMAC-SHA256)
+        blake2s,            // V2 signatures (keyed BLAKE2s)
+        encode,
+        verify,
+        csvParse,
+        ledgerWrite,
+        queueInteractive,   // time a job waited for a worker, by class
+        queueBulk,
+        count
+    };
+
+    constexpr size_t kNumStages = static_cast<size_t>(Stage::count);
+
+    const char* stageName(Stage stage) noexcept;
+
+    void record(Stage stage, uint64_t nanos) noexcept;
+    void addRows(uint64_t rows) noexcept;
+    void addCacheLookup(bool hit) noexcept;
+
+    // Jobs currently waiting in the worker scheduler's queues (a gauge, not reset()).
+    void setQueueDepths(uint64_t interactive, uint64_t bulk) noexcept;
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Stage s) noexcept
+            : stage(s), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            record(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct StageSnapshot
+    {
+        uint64_t count = 0;
+        uint64_t totalNanos = 0;
+        uint64_t p50Nanos = 0;
+        uint64_t p99Nanos = 0;
+        uint64_t p999Nanos = 0;
+    };
+
+    struct Snapshot
+    {
+        std::array<StageSnapshot, kNumStages> stages{};
+        uint64_t rows = 0;
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;
+        uint64_t queuedInteractive = 0;
+        uint64_t queuedBulk = 0;
+        uint64_t residentBytes = 0;
+        double uptimeSeconds = 0.0;
+    };
+
+    Snapshot snapshot();
+    void reset() noexcept;
+
+    // What was recorded between construction and snapshot(), leaving the
+    // process-wide counters alone for everyone else reading them.
+    class Interval
+    {
+    public:
+        Interval();
+        ~Interval();
+
+        Snapshot snapshot() const;
+
+        Interval(const Interval&) = delete;
+        Interval& operator=(const Interval&) = delete;
+
+    private:
+        struct Baseline;
+        std::unique_ptr<Baseline> baseline;
+    };
+
+    // Current resident set size of this process, or 0 if the platform can't tell us.
+    uint64_t residentMemoryBytes() noexcept;
+
+    // High-water mark of the resident set size since the process started.
+    uint64_t peakResidentMemoryBytes() noexcept;
+
+    std::string toJson(const Snapshot& snap);
+} // namespace metrics
@@ -0,0 +1,175 @@
+#include "packed_license.h"
+
+#include <array>
+
+namespace license
+{
+    namespace
+    {
+        // Character -> value for the upper-case characters StandardFormat::parse lets through.
+        constexpr auto kBase32Values = []
+        {
+            std::array<uint8_t, 256> values {};
+            for (uint8_t i = 0; i < 32; ++i)
+                values[static_cast<unsigned char>(kBase32Alphabet[i])] = i;
+            return values;
+        }();
+
+        // Writes date as eight digits, zero padded.
+        void writeDate(uint32_t date, char* out) noexcept
+        {
+            for (size_t i = StandardFormat::dateChars; i-- > 0; date /= 10)
+                out[i] = static_cast<char>('0' + date % 10);
+        }
+
+        bool isDigit(char c) noexcept
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        // Howard Hinnant's days_from_civil.
+        int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) noexcept
+        {
+            y -= m <= 2;
+            const int64_t era = (y >= 0 ? y : y - 399) / 400;
+            const auto yoe = static_cast<unsigned>(y - era * 400);
+            const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+            const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+            return era * 146097 + static_cast<int64_t>(doe) - 719468;
+        }
+
+        unsigned daysInMonth(int64_t y, unsigned m) noexcept
+        {
+            static constexpr unsigned lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+            const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+            return m == 2 && leap ? 29u : lengths[m - 1];
+        }
+    }
+
+    bool daysFromYYYYMMDD(std::string_view yyyymmdd, uint32_t& days) noexcept
+    {
+        if (yyyymmdd.size() != 8)
+            return false;
+        for (char c : yyyymmdd)
+            if (! isDigit(c))
+                return false;
+
+        auto number = [&](size_t from, size_t count)
+        {
+            unsigned v = 0;
+            for (size_t i = from; i < from + count; ++i)
+                v = v * 10 + static_cast<unsigned>(yyyymmdd[i] - '0');
+            return v;
+        };
+
+        const int64_t y = number(0, 4);
+        const unsigned m = number(4, 2);
+        const unsigned d = number(6, 2);
+        if (y < 1970 || m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m))
+            return false;
+
+        days = static_cast<uint32_t>(daysFromCivil(y, m, d));
+        return true;
+    }
+
+    bool PackedLicense::parse(std::string_view text, PackedLicense& out) noexcept
+    {
+        out = {};
+
+        StandardFormat::Text canonical;
+        if (! StandardFormat::parse(text, canonical))
+            return false;
+
+        const auto version = StandardFormat::version(canonical);
+        if (version[0] != 'V' || version[1] < '1' || version[1] > '9')
+            return false;
+
+        PackedLicense key;
+        key.version = static_cast<uint8_t>(version[1] - '0');
+
+        for (const char c : StandardFormat::date(canonical))
+            key.date = key.date * 10 + static_cast<uint32_t>(c - '0');
+
+        for (const char c : StandardFormat::signature(canonical))
+            key.signature = (key.signature << 5) | kBase32Values[static_cast<unsigned char>(c)];
+
+        out = key;
+        return true;
+    }
+
+    void PackedLicense::format(char* out) const noexcept
+    {
+        const char tag[StandardFormat::versionChars] = { 'V', static_cast<char>('0' + version) };
+
+        char digits[StandardFormat::dateChars];
+        writeDate(date, digits);
+
+        StandardFormat::Signature chars;
+        for (size_t i = 0; i < StandardFormat::signatureChars; ++i)
+            chars[i] = kBase32Alphabet[(signature >> ((StandardFormat::signatureChars - 1 - i) * 5)) & 0x1f];
+
+        StandardFormat::format(out, tag, digits, chars);
+    }
+
+    std::string PackedLicense::toString() const
+    {
+        if (! isValid())
+            return {};
+
+        std::string text(textLength, ' ');
+        format(text.data());
+        return text;
+    }
+
+    std::string PackedLicense::dateText() const
+    {
+        std::string text(StandardFormat::dateChars, '0');
+        writeDate(date, text.data());
+        return text;
+    }
+
+    void radixSort(std::vector<PackedLicense>& keys)
+    {
+        if (keys.size() < 2)
+            return;
+
+        // Least significant first: four signature digits, two date digits, the version.
+        using Digit = uint32_t (*)(const PackedLicense&);
+        static constexpr Digit digits[] =
+        {
+            [](const PackedLicense& k) { return static_cast<uint32_t>(k.signature & 0xffff); },
+            [](const PackedLicense& k) { return static_cast<uint32_t>((k.signature >> 16) & 0xffff); },
+            [](const PackedLicense& k) { return static_cast<uint32_t>((k.signature >> 32) & 0xffff); },
+            [](const PackedLicense& k) { return static_cast<uint32_t>((k.signature >> 48) & 0xffff); },
+            [](const PackedLicense& k) { return k.date & 0xffff; },
+            [](const PackedLicense& k) { return k.date >> 16; },
+            [](const PackedLicense& k) { return static_cast<uint32_t>(k.version); },
+        };
+
+        std::vector<PackedLicense> scratch(keys.size());
+        std::vector<size_t> counts(size_t(1) << 16);
+
+        for (const auto digit : digits)
+        {
+            std::fill(counts.begin(), counts.end(), size_t(0));
+            for (const auto& k : keys)
+                ++counts[digit(k)];
+
+            if (counts[digit(keys.front())] == keys.size())
+                continue;
+
+            size_t offset = 0;
+            for (auto& c : counts)
+            {
+                const size_t n = c;
+                c = offset;
+                offset += n;
+            }
+
+            for (const auto& k : keys)
+                scratch[counts[digit(k)]++] = k;
+
+            keys.swap(scratch);
+        }
+    }
+} // namespace license
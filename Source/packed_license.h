@@ -0,0 +1,91 @@
+#pragma once
+
+#include "license_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+    Compact form of a license key for large key sets.
+
+    VERSION-YYYYMMDD-XXXX-XXXX-XXXX packs into 16 bytes: the 60-bit signature
+    (the twelve Base32 characters with the first in the top bits, which are
+    also the top 60 bits of the MAC), the date digits as one number and the
+    version number. Packed keys hash, compare and sort as integers; text
+    only appears at the edges through parse() and toString(), which are
+    built on StandardFormat so both read a key the same way.
+
+    Ordering is by version, date, then signature value. That matches the
+    textual order except within a single date, where the Base32 value order
+    puts 'A' before '2'.
+*/
+namespace license
+{
+    struct PackedLicense
+    {
+        uint64_t signature = 0;
+        uint32_t date = 0;    // the YYYYMMDD digits read as a number
+        uint8_t version = 0;  // 0 marks an empty key
+
+        static constexpr size_t textLength = StandardFormat::length;
+
+        // Accepts whatever StandardFormat::parse accepts (any case, whitespace
+        // anywhere, any eight date digits) with a V1..V9 version tag; returns
+        // false and leaves out empty otherwise.
+        static bool parse(std::string_view text, PackedLicense& out) noexcept;
+
+        // Writes exactly textLength characters, no terminator.
+        void format(char* out) const noexcept;
+        std::string toString() const;
+
+        // The date as it appears in the key: eight digits.
+        std::string dateText() const;
+
+        bool isValid() const noexcept { return version != 0; }
+
+        friend bool operator==(const PackedLicense& a, const PackedLicense& b) noexcept
+        {
+            return a.signature == b.signature && a.date == b.date && a.version == b.version;
+        }
+
+        friend bool operator!=(const PackedLicense& a, const PackedLicense& b) noexcept
+        {
+            return ! (a == b);
+        }
+
+        friend bool operator<(const PackedLicense& a, const PackedLicense& b) noexcept
+        {
+            if (a.version != b.version)
+                return a.version < b.version;
+            if (a.date != b.date)
+                return a.date < b.date;
+            return a.signature < b.signature;
+        }
+    };
+
+    static_assert(sizeof(PackedLicense) <= 16, "PackedLicense must stay within 16 bytes");
+    static_assert(StandardFormat::signatureBits <= 64 && StandardFormat::versionChars == 2,
+                  "PackedLicense holds StandardFormat keys");
+
+    // Proleptic Gregorian YYYYMMDD -> days since 1970-01-01; false unless
+    // it is a real calendar date from 1970 on.
+    bool daysFromYYYYMMDD(std::string_view yyyymmdd, uint32_t& days) noexcept;
+
+    // Sorts into operator< order with 16-bit LSD radix passes, skipping any
+    // pass whose digit is the same for every key.
+    void radixSort(std::vector<PackedLicense>& keys);
+} // namespace license
+
+template <>
+struct std::hash<license::PackedLicense>
+{
+    size_t operator()(const license::PackedLicense& key) const noexcept
+    {
+        // The signature is already uniformly distributed HMAC output.
+        const uint64_t h = key.signature ^ ((static_cast<uint64_t>(key.date) << 8 | key.version) * 0x9e3779b97f4a7c15ull);
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+};
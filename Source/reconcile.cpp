@@ -0,0 +1,499 @@
+#include "reconcile.h"
+#include "batch.h"
+#include "license.h"
+#include "metrics.h"
+#include "sinks.h"
+#include "trace.h"
+#include "workers.h"
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace reconcile
+{
+    namespace
+    {
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+        constexpr size_t kMaxSpillBuffer = 256 * 1024;
+
+        enum Side
+        {
+            orderSide = 0,
+            ledgerSide = 1
+        };
+
+        struct Record
+        {
+            std::string identity;   // the join key
+            std::string first;
+            std::string last;
+            std::string email;
+            std::string license;    // empty for orders
+
+            size_t bytes() const noexcept
+            {
+                return sizeof(Record) + identity.size() + first.size() + last.size() + email.size() + license.size();
+            }
+
+            batch::Row toRow() const
+            {
+                return { juce::String::fromUTF8(first.data(), static_cast<int>(first.size())),
+                         juce::String::fromUTF8(last.data(), static_cast<int>(last.size())),
+                         juce::String::fromUTF8(email.data(), static_cast<int>(email.size())),
+                         juce::String::fromUTF8(license.data(), static_cast<int>(license.size())) };
+            }
+        };
+
+        // Spill files hold records as five length-prefixed fields.
+        void appendField(std::string& out, const std::string& field)
+        {
+            const auto size = static_cast<uint32_t>(field.size());
+            char prefix[4] = { static_cast<char>(size & 0xff), static_cast<char>((size >> 8) & 0xff),
+                               static_cast<char>((size >> 16) & 0xff), static_cast<char>((size >> 24) & 0xff) };
+            out.append(prefix, 4);
+            out.append(field);
+        }
+
+        void appendRecord(std::string& out, const Record& r)
+        {
+            appendField(out, r.identity);
+            appendField(out, r.first);
+            appendField(out, r.last);
+            appendField(out, r.email);
+            appendField(out, r.license);
+        }
+
+        bool readField(const char*& p, const char* end, std::string& field)
+        {
+            if (end - p < 4)
+                return false;
+
+            const auto* u = reinterpret_cast<const unsigned char*>(p);
+            const size_t size = u[0] | (size_t(u[1]) << 8) | (size_t(u[2]) << 16) | (size_t(u[3]) << 24);
+            p += 4;
+            if (static_cast<size_t>(end - p) < size)
+                return false;
+
+            field.assign(p, size);
+            p += size;
+            return true;
+        }
+
+        bool readRecords(const juce::File& file, std::vector<Record>& out)
+        {
+            juce::MemoryBlock data;
+            if (! file.loadFileAsData(data))
+                return false;
+
+            const char* p = static_cast<const char*>(data.getData());
+            const char* end = p + data.getSize();
+            while (p < end)
+            {
+                Record r;
+                if (! readField(p, end, r.identity) || ! readField(p, end, r.first) || ! readField(p, end, r.last)
+                    || ! readField(p, end, r.email) || ! readField(p, end, r.license))
+                    return false;
+                out.push_back(std::move(r));
+            }
+            return true;
+        }
+
+        struct Partition
+        {
+            std::vector<Record> rows[2];
+            std::string spillBuffer[2];
+            juce::File spillFile[2];
+            size_t memory = 0;
+            bool spilled = false;
+        };
+
+        // Owns the partitions during the scan and keeps their total memory
+        // under the budget by spilling the largest ones.
+        class Partitioner
+        {
+        public:
+            Partitioner(size_t count, size_t budgetBytes, const juce::File& workDir)
+                : partitions(count), budget(budgetBytes),
+                  flushAt(juce::jlimit<size_t>(4096, kMaxSpillBuffer, budgetBytes / (count * 4)))
+            {
+                for (size_t i = 0; i < count; ++i)
+                    for (int side = 0; side < 2; ++side)
+                        partitions[i].spillFile[side] = workDir.getChildFile((side == orderSide ? "orders-" : "ledger-")
+                                                                             + juce::String(static_cast<juce::int64>(i)) + ".part");
+            }
+
+            size_t partitionOf(const std::string& identity) const noexcept
+            {
+                return std::hash<std::string>{}(identity) % partitions.size();
+            }
+
+            bool add(Side side, Record&& r)
+            {
+                auto& p = partitions[partitionOf(r.identity)];
+
+                if (p.spilled)
+                {
+                    auto& buffer = p.spillBuffer[side];
+                    const auto before = buffer.size();
+                    appendRecord(buffer, r);
+                    used += buffer.size() - before;
+                    p.memory += buffer.size() - before;
+                    if (buffer.size() >= flushAt && ! flush(p, side))
+                        return false;
+                }
+                else
+                {
+                    used += r.bytes();
+                    p.memory += r.bytes();
+                    p.rows[side].push_back(std::move(r));
+                }
+
+                while (used > budget)
+                    if (! spillLargest())
+                        break;
+
+                return ok;
+            }
+
+            bool finish()
+            {
+                for (auto& p : partitions)
+                    if (p.spilled && (! flush(p, orderSide) || ! flush(p, ledgerSide)))
+                        return false;
+                return ok;
+            }
+
+            std::vector<Partition>& all() noexcept { return partitions; }
+
+            size_t spilledCount() const noexcept
+            {
+                size_t n = 0;
+                for (const auto& p : partitions)
+                    n += p.spilled ? 1 : 0;
+                return n;
+            }
+
+        private:
+            bool flush(Partition& p, int side)
+            {
+                auto& buffer = p.spillBuffer[side];
+                if (buffer.empty())
+                    return ok;
+
+                ok = p.spillFile[side].appendData(buffer.data(), buffer.size()) && ok;
+                used -= juce::jmin(used, buffer.size());
+                p.memory -= juce::jmin(p.memory, buffer.size());
+                buffer.clear();
+                buffer.shrink_to_fit();
+                return ok;
+            }
+
+            bool spillLargest()
+            {
+                Partition* largest = nullptr;
+                for (auto& p : partitions)
+                    if (! p.spilled && ! (p.rows[orderSide].empty() && p.rows[ledgerSide].empty())
+                        && (largest == nullptr || p.memory > largest->memory))
+                        largest = &p;
+
+                if (largest == nullptr)
+                    return false;
+
+                for (int side = 0; side < 2; ++side)
+                {
+                    std::string buffer;
+                    for (const auto& r : largest->rows[side])
+                        appendRecord(buffer, r);
+                    largest->rows[side] = {};
+                    if (! buffer.empty())
+                        ok = largest->spillFile[side].appendData(buffer.data(), buffer.size()) && ok;
+                }
+
+                used -= juce::jmin(used, largest->memory);
+                largest->memory = 0;
+                largest->spilled = true;
+                return ok;
+            }
+
+            std::vector<Partition> partitions;
+            const size_t budget;
+            const size_t flushAt;
+            size_t used = 0;
+            bool ok = true;
+        };
+
+        bool looksLikeHeader(const juce::StringArray& fields)
+        {
+            return fields.size() >= 3 && fields[0].trim().equalsIgnoreCase("first")
+                && fields[1].trim().equalsIgnoreCase("last") && fields[2].trim().equalsIgnoreCase("email");
+        }
+
+        // Orders keep their first three columns; ledger rows also their last (the key).
+        bool parseRecord(const juce::String& line, Side side, Record& out)
+        {
+            const auto fields = batch::splitCsvLine(line);
+            if (fields.size() < (side == orderSide ? 3 : 4))
+                return false;
+
+            out.first = fields[0].trim().toStdString();
+            out.last = fields[1].trim().toStdString();
+            out.email = fields[2].trim().toStdString();
+            if (side == ledgerSide)
+                out.license = fields[fields.size() - 1].trim().toStdString();
+
+            if (out.first.empty() || out.last.empty() || out.email.empty() || (side == ledgerSide && out.license.empty()))
+                return false;
+
+            out.identity = license::identityOf(out.first, out.last, out.email);
+            return true;
+        }
+
+        // Streams file in chunks of whole lines, parsing each chunk across the workers.
+        bool scan(const juce::File& file, Side side, Partitioner& partitioner, juce::int64& rows, juce::int64& malformed)
+        {
+            SMK_TRACE_SCOPE("reconcileScan");
+
+            juce::FileInputStream in(file);
+            if (! in.openedOk())
+                return false;
+
+            juce::MemoryBlock pending;
+            bool atFileStart = true;
+
+            while (! in.isExhausted() || pending.getSize() > 0)
+            {
+                const auto keep = pending.getSize();
+                pending.setSize(keep + static_cast<size_t>(kChunkBytes));
+                const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(kChunkBytes));
+                pending.setSize(keep + static_cast<size_t>(juce::jmax(0, got)));
+
+                const auto* data = static_cast<const char*>(pending.getData());
+                size_t cut = pending.getSize();
+                if (! in.isExhausted())
+                    while (cut > 0 && data[cut - 1] != '\n')
+                        --cut;
+
+                juce::StringArray lines;
+                lines.addLines(juce::String::fromUTF8(data, static_cast<int>(cut)));
+                pending.removeSection(0, cut);
+
+                if (atFileStart && ! lines.isEmpty() && looksLikeHeader(batch::splitCsvLine(lines[0])))
+                    lines.remove(0);
+                atFileStart = false;
+
+                std::vector<Record> parsed(static_cast<size_t>(lines.size()));
+                std::vector<char> valid(parsed.size(), 0);
+                workers::parallelFor(parsed.size(), [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                        valid[i] = parseRecord(lines[static_cast<int>(i)], side, parsed[i]) ? 1 : 0;
+                });
+
+                for (size_t i = 0; i < parsed.size(); ++i)
+                {
+                    if (! valid[i])
+                    {
+                        if (lines[static_cast<int>(i)].trim().isNotEmpty())
+                            ++malformed;
+                        continue;
+                    }
+
+                    ++rows;
+                    if (! partitioner.add(side, std::move(parsed[i])))
+                        return false;
+                }
+
+                if (got <= 0 && cut == 0)
+                    break;
+            }
+
+            return true;
+        }
+
+        struct Joined
+        {
+            std::vector<batch::Row> missing;
+            std::vector<batch::Row> orphans;
+            std::vector<batch::Row> mismatches;
+            bool ok = true;
+        };
+
+        Joined join(Partition& p)
+        {
+            SMK_TRACE_SCOPE("reconcileJoin");
+            Joined out;
+
+            if (p.spilled)
+            {
+                for (int side = 0; side < 2; ++side)
+                    if (p.spillFile[side].existsAsFile())
+                        out.ok = readRecords(p.spillFile[side], p.rows[side]) && out.ok;
+            }
+
+            const auto& orders = p.rows[orderSide];
+            const auto& ledger = p.rows[ledgerSide];
+
+            // Build on the ledger side, probe with the orders.
+            std::unordered_set<std::string_view> issued;
+            issued.reserve(ledger.size());
+            for (const auto& r : ledger)
+                issued.insert(r.identity);
+
+            std::unordered_set<std::string_view> ordered;
+            ordered.reserve(orders.size());
+            for (const auto& r : orders)
+                if (ordered.insert(r.identity).second && issued.count(r.identity) == 0)
+                    out.missing.push_back(r.toRow());
+
+            const auto& key = license::SigningKey::builtIn();
+            for (const auto& r : ledger)
+            {
+                if (ordered.count(r.identity) == 0)
+                    out.orphans.push_back(r.toRow());
+                else if (! key.verifyLicense(r.license, r.first, r.last, r.email))
+                    out.mismatches.push_back(r.toRow());
+            }
+
+            p.rows[orderSide] = {};
+            p.rows[ledgerSide] = {};
+            return out;
+        }
+
+        juce::String optionValue(const juce::StringArray& args, const juce::String& name, const juce::String& fallback = {})
+        {
+            for (const auto& arg : args)
+                if (arg.startsWith(name + "="))
+                    return arg.fromFirstOccurrenceOf("=", false, false);
+            return fallback;
+        }
+    }
+
+    juce::Result reconcile(const juce::File& orders, const juce::File& ledger, const juce::File& outputDirectory,
+                           size_t memoryBudgetBytes, Summary& summary)
+    {
+        SMK_TRACE_SCOPE("reconcile");
+
+        if (outputDirectory.createDirectory().failed())
+            return juce::Result::fail("failed to create " + outputDirectory.getFullPathName());
+
+        const auto workDir = outputDirectory.getChildFile(".reconcile-work");
+        workDir.deleteRecursively();
+        if (workDir.createDirectory().failed())
+            return juce::Result::fail("failed to create " + workDir.getFullPathName());
+
+        // Enough partitions that one per worker, held in memory at once as
+        // records (about three times the CSV size), fits the budget.
+        const auto inputBytes = static_cast<size_t>(orders.getSize() + ledger.getSize());
+        const auto threads = workers::numWorkers();
+        size_t count = 16;
+        while (count < 65536 && (inputBytes * 3 / count) * threads > memoryBudgetBytes)
+            count *= 2;
+
+        Partitioner partitioner(count, memoryBudgetBytes, workDir);
+        summary.partitions = count;
+
+        const bool scanned = scan(orders, orderSide, partitioner, summary.orders, summary.malformed)
+                          && scan(ledger, ledgerSide, partitioner, summary.ledgerRows, summary.malformed)
+                          && partitioner.finish();
+        summary.spilledPartitions = partitioner.spilledCount();
+
+        auto missing = sinks::open(outputDirectory.getChildFile("missing.csv"), sinks::Format::csv);
+        auto orphans = sinks::open(outputDirectory.getChildFile("orphans.csv"), sinks::Format::csv);
+        auto mismatches = sinks::open(outputDirectory.getChildFile("mismatches.csv"), sinks::Format::csv);
+
+        if (! scanned || missing == nullptr || orphans == nullptr || mismatches == nullptr)
+        {
+            workDir.deleteRecursively();
+            return juce::Result::fail(scanned ? "failed to write to " + outputDirectory.getFullPathName()
+                                              : "failed to read the inputs or spill partitions");
+        }
+
+        // One wave of partitions per worker, so only that many are loaded at once.
+        auto& partitions = partitioner.all();
+        bool ok = true;
+        for (size_t wave = 0; wave < partitions.size(); wave += threads)
+        {
+            const size_t waveSize = juce::jmin(threads, partitions.size() - wave);
+            std::vector<Joined> joined(waveSize);
+            workers::parallelFor(waveSize, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    joined[i] = join(partitions[wave + i]);
+            });
+
+            for (const auto& j : joined)
+            {
+                ok = j.ok && ok;
+                for (const auto& row : j.missing)
+                    ok = missing->write(row) && ok;
+                for (const auto& row : j.orphans)
+                    ok = orphans->write(row) && ok;
+                for (const auto& row : j.mismatches)
+                    ok = mismatches->write(row) && ok;
+
+                summary.missing += static_cast<juce::int64>(j.missing.size());
+                summary.orphans += static_cast<juce::int64>(j.orphans.size());
+                summary.mismatches += static_cast<juce::int64>(j.mismatches.size());
+            }
+        }
+
+        ok = missing->close() && ok;
+        ok = orphans->close() && ok;
+        ok = mismatches->close() && ok;
+        workDir.deleteRecursively();
+
+        metrics::addRows(static_cast<uint64_t>(summary.orders + summary.ledgerRows));
+
+        if (! ok)
+            return juce::Result::fail("failed to write the reconciliation to " + outputDirectory.getFullPathName());
+
+        return juce::Result::ok();
+    }
+
+    bool handles(const juce::StringArray& args)
+    {
+        return args.contains("--reconcile");
+    }
+
+    commands::Result run(const juce::StringArray& args, const juce::File& cwd)
+    {
+        const int i = args.indexOf("--reconcile");
+        if (i < 0 || args.size() < i + 4)
+            return { 1, "usage: --reconcile <orders.csv> <ledger.csv> <out-dir> [--memory-mb=256]" };
+
+        const auto orders = cwd.getChildFile(args[i + 1]);
+        const auto ledger = cwd.getChildFile(args[i + 2]);
+        const auto outDir = cwd.getChildFile(args[i + 3]);
+        if (! orders.existsAsFile())
+            return { 1, "orders not found: " + orders.getFullPathName() };
+        if (! ledger.existsAsFile())
+            return { 1, "ledger not found: " + ledger.getFullPathName() };
+
+        const int memoryMb = optionValue(args, "--memory-mb", "256").getIntValue();
+        if (memoryMb < 16)
+            return { 1, "--memory-mb must be at least 16" };
+
+        Summary summary;
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        const auto r = reconcile(orders, ledger, outDir, static_cast<size_t>(memoryMb) * 1024 * 1024, summary);
+        if (r.failed())
+            return { 1, r.getErrorMessage() };
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+        juce::String text;
+        text << summary.orders << " orders against " << summary.ledgerRows << " ledger rows in "
+             << juce::String(seconds, 2) << " s\n"
+             << summary.missing << " customers missing a key -> missing.csv\n"
+             << summary.orphans << " keys without an order -> orphans.csv\n"
+             << summary.mismatches << " keys that don't verify -> mismatches.csv\n"
+             << summary.malformed << " malformed rows skipped; "
+             << juce::String(static_cast<juce::int64>(summary.spilledPartitions)) << " of "
+             << juce::String(static_cast<juce::int64>(summary.partitions)) << " partitions spilled to disk";
+        return { 0, text };
+    }
+} // namespace reconcile
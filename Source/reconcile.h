@@ -0,0 +1,46 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+
+/*
+    Reconciliation of an order export against the license ledger.
+
+        --reconcile <orders.csv> <ledger.csv> <out-dir> [--memory-mb=256]
+
+    Orders are first,last,email[,...] and ledger rows First,Last,Email,
+    GeneratedAt,License; both are joined on the normalised identity that
+    keys are signed over (license::identityOf). Three CSVs come out:
+
+        missing.csv     customers with an order but no key in the ledger
+        orphans.csv     ledger keys whose customer has no order
+        mismatches.csv  keys of ordering customers that don't verify for the
+                        identity on record
+
+    A partitioned hash join: both inputs are streamed in 8 MB chunks and
+    hashed into partitions on identity. Partitions stay in memory until the
+    budget is reached, then the largest are spilled to work files in
+    <out-dir>. Partitions are then joined a wave at a time, one per worker,
+    so peak memory stays around twice the budget whatever the input size.
+    Output rows are grouped by partition rather than in input order.
+*/
+namespace reconcile
+{
+    struct Summary
+    {
+        juce::int64 orders = 0;
+        juce::int64 ledgerRows = 0;
+        juce::int64 malformed = 0;
+        juce::int64 missing = 0;
+        juce::int64 orphans = 0;
+        juce::int64 mismatches = 0;
+        size_t partitions = 0;
+        size_t spilledPartitions = 0;
+    };
+
+    juce::Result reconcile(const juce::File& orders, const juce::File& ledger, const juce::File& outputDirectory,
+                           size_t memoryBudgetBytes, Summary& summary);
+
+    bool handles(const juce::StringArray& args);
+    commands::Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+} // namespace reconcile
@@ -0,0 +1,312 @@
+#include "renew.h"
+#include "batch.h"
+#include "identity_store.h"
+#include "license.h"
+#include "metrics.h"
+#include "sinks.h"
+#include "trace.h"
+#include "workers.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace renew
+{
+    namespace
+    {
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+
+        struct Candidate
+        {
+            batch::Row row;
+            license::PackedLicense currentKey;
+            size_t slot = 0;        // position of the identity in the ledger's IdentityStore
+            bool known = false;     // found in the store
+            bool verified = false;
+            bool renewed = false;   // the first verified row of an identity not renewed before
+        };
+
+        // Ledger rows are First,Last,Email,GeneratedAt,License; a batch output
+        // (first,last,email,license) works too since the key is always last.
+        bool parseCandidate(const juce::String& line, Candidate& out)
+        {
+            const auto fields = batch::splitCsvLine(line);
+            if (fields.size() < 4)
+                return false;
+
+            out.row.first = fields[0].trim();
+            out.row.last = fields[1].trim();
+            out.row.email = fields[2].trim();
+            const auto key = fields[fields.size() - 1].trim();
+
+            // A key that doesn't parse stays empty and is counted as unverified.
+            license::PackedLicense::parse(key.toRawUTF8(), out.currentKey);
+
+            return out.row.first.isNotEmpty() && out.row.last.isNotEmpty()
+                && out.row.email.isNotEmpty() && key.isNotEmpty();
+        }
+
+        // Calls fn(lines, atFileStart) for each 8 MB run of complete lines in
+        // the first limit bytes of the stream (or all of it when limit < 0).
+        template <typename Fn>
+        void forEachChunk(juce::FileInputStream& in, juce::int64 limit, Fn&& fn)
+        {
+            juce::MemoryBlock pending;
+            bool atFileStart = true;
+
+            auto exhausted = [&] { return in.isExhausted() || (limit >= 0 && in.getPosition() >= limit); };
+
+            while (! exhausted() || pending.getSize() > 0)
+            {
+                const auto wanted = limit < 0 ? kChunkBytes : juce::jlimit<juce::int64>(0, kChunkBytes, limit - in.getPosition());
+                const auto keep = pending.getSize();
+                pending.setSize(keep + static_cast<size_t>(wanted));
+                const int got = wanted > 0 ? in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(wanted)) : 0;
+                pending.setSize(keep + static_cast<size_t>(juce::jmax(0, got)));
+
+                // Complete lines only, unless this is the tail of what is read.
+                const auto* data = static_cast<const char*>(pending.getData());
+                size_t cut = pending.getSize();
+                if (! exhausted())
+                    while (cut > 0 && data[cut - 1] != '\n')
+                        --cut;
+
+                juce::StringArray lines;
+                lines.addLines(juce::String::fromUTF8(data, static_cast<int>(cut)));
+                pending.removeSection(0, cut);
+
+                fn(lines, atFileStart);
+                atFileStart = false;
+
+                if (got <= 0 && cut == 0)
+                    break;
+            }
+        }
+
+        bool isHeaderOrBlank(const juce::StringArray& lines, int i, bool atFileStart)
+        {
+            return lines[i].trim().isEmpty()
+                || (atFileStart && i == 0 && lines[i].startsWithIgnoreCase("first,"));
+        }
+
+        // Every identity in the ledger, so duplicates can be tracked with one
+        // bit each. length is set to the bytes read, which bounds the second
+        // pass: rows appended after this are left for the next renewal.
+        identities::IdentityStore collectIdentities(juce::FileInputStream& in, juce::int64& length)
+        {
+            SMK_TRACE_SCOPE("collectIdentities");
+
+            identities::IdentityStore::Builder builder;
+            forEachChunk(in, -1, [&](const juce::StringArray& lines, bool atFileStart)
+            {
+                for (int i = 0; i < lines.size(); ++i)
+                {
+                    Candidate c;
+                    if (! isHeaderOrBlank(lines, i, atFileStart) && parseCandidate(lines[i], c))
+                        builder.add(c.row.first.toStdString(), c.row.last.toStdString(), c.row.email.toStdString());
+                }
+            });
+            length = in.getPosition();
+            return builder.build();
+        }
+
+        bool isKnownScheme(const license::PackedLicense& key)
+        {
+            return key.version == static_cast<uint8_t>(license::Scheme::v1)
+                || key.version == static_cast<uint8_t>(license::Scheme::v2);
+        }
+
+        // Rows of one identity, in ledger order, are positions [begin, end) of `order`.
+        struct Group
+        {
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        // Checks every row of one identity with a single signer, and signs only
+        // the first one that verifies, unless an earlier chunk renewed it.
+        void renewGroup(std::vector<Candidate>& candidates, const std::vector<size_t>& order, const Group& group,
+                        const std::vector<bool>& seen, const std::string& yyyymmdd, license::Scheme scheme)
+        {
+            auto& head = candidates[order[group.begin]];
+            const auto current = static_cast<license::Scheme>(isKnownScheme(head.currentKey) ? head.currentKey.version
+                                                                                          : static_cast<uint8_t>(scheme));
+            const license::IdentitySigner signer(head.row.first.toStdString(), head.row.last.toStdString(),
+                                                 head.row.email.toStdString(), { current, scheme });
+
+            bool claimed = seen[head.slot];
+            for (size_t i = group.begin; i < group.end; ++i)
+            {
+                auto& c = candidates[order[i]];
+                c.verified = signer.verifyLicense(c.currentKey);
+                if (c.verified && ! claimed)
+                {
+                    c.row.license = signer.makeLicense(yyyymmdd, scheme);
+                    c.renewed = claimed = true;
+                }
+            }
+        }
+
+        // Looks every candidate up in the store, then verifies and signs one
+        // identity at a time across the workers, and waits for all of them.
+        // Duplicates are verified, so they are counted apart from bad keys,
+        // but never signed.
+        void renewAll(std::vector<Candidate>& candidates, const identities::IdentityStore& store,
+                      const std::vector<bool>& seen, const std::string& yyyymmdd, license::Scheme scheme)
+        {
+            workers::parallelFor(candidates.size(), [&](size_t begin, size_t end)
+            {
+                SMK_TRACE_SCOPE("renewLookup");
+                for (size_t i = begin; i < end; ++i)
+                {
+                    auto& c = candidates[i];
+                    c.known = store.find(c.row.first.toStdString(), c.row.last.toStdString(),
+                                         c.row.email.toStdString(), c.slot);
+                }
+            });
+
+            std::vector<size_t> order;
+            order.reserve(candidates.size());
+            for (size_t i = 0; i < candidates.size(); ++i)
+                if (candidates[i].known)
+                    order.push_back(i);
+
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+            {
+                return candidates[a].slot < candidates[b].slot;
+            });
+
+            std::vector<Group> groups;
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                if (groups.empty() || candidates[order[groups.back().begin]].slot != candidates[order[i]].slot)
+                    groups.push_back({ i, i });
+                groups.back().end = i + 1;
+            }
+
+            workers::parallelFor(groups.size(), [&](size_t begin, size_t end)
+            {
+                SMK_TRACE_SCOPE("renewRange");
+                for (size_t g = begin; g < end; ++g)
+                    renewGroup(candidates, order, groups[g], seen, yyyymmdd, scheme);
+            });
+        }
+
+        juce::String optionValue(const juce::StringArray& args, const juce::String& name, const juce::String& fallback = {})
+        {
+            for (const auto& arg : args)
+                if (arg.startsWith(name + "="))
+                    return arg.fromFirstOccurrenceOf("=", false, false);
+            return fallback;
+        }
+    }
+
+    juce::Result renewLedger(const juce::File& ledger, const juce::File& output,
+                             const std::string& yyyymmdd, Summary& summary, license::Scheme scheme)
+    {
+        SMK_TRACE_SCOPE("renewLedger");
+
+        juce::FileInputStream in(ledger);
+        if (! in.openedOk())
+            return juce::Result::fail("failed to read " + ledger.getFullPathName());
+
+        auto sink = sinks::open(output, sinks::formatFor(output));
+        if (sink == nullptr)
+            return juce::Result::fail("failed to write " + output.getFullPathName());
+
+        juce::int64 length = 0;
+        const auto store = collectIdentities(in, length);
+        if (! in.setPosition(0))
+            return juce::Result::fail("failed to read " + ledger.getFullPathName());
+
+        std::vector<bool> seen(store.size());
+        bool writeOk = true;
+        std::vector<Candidate> candidates;
+        forEachChunk(in, length, [&](const juce::StringArray& lines, bool atFileStart)
+        {
+            candidates.clear();
+            candidates.reserve(static_cast<size_t>(lines.size()));
+
+            for (int i = 0; i < lines.size(); ++i)
+            {
+                if (isHeaderOrBlank(lines, i, atFileStart))
+                    continue;
+
+                Candidate c;
+                if (parseCandidate(lines[i], c))
+                    candidates.push_back(std::move(c));
+                else
+                    ++summary.malformed;
+            }
+
+            renewAll(candidates, store, seen, yyyymmdd, scheme);
+
+            // Ledger order decides which row of a duplicated identity wins.
+            for (const auto& c : candidates)
+            {
+                if (! c.verified)
+                    ++summary.unverified;
+                else if (! c.renewed)
+                    ++summary.duplicates;
+                else
+                {
+                    seen[c.slot] = true;
+                    writeOk = sink->write(c.row) && writeOk;
+                    ++summary.renewed;
+                }
+            }
+        });
+
+        metrics::addRows(static_cast<uint64_t>(summary.renewed));
+
+        const bool closed = sink->close();
+        if (const auto rejected = sink->rejectedRows(); rejected > 0)
+            return juce::Result::fail(juce::String(rejected) + " renewed rows have a field too wide for "
+                                      + sinks::formatName(sinks::formatFor(output)) + " output");
+
+        if (! closed || ! writeOk)
+            return juce::Result::fail("failed to write " + output.getFullPathName());
+
+        return juce::Result::ok();
+    }
+
+    bool handles(const juce::StringArray& args)
+    {
+        return args.contains("--renew");
+    }
+
+    commands::Result run(const juce::StringArray& args, const juce::File& cwd)
+    {
+        const int i = args.indexOf("--renew");
+        if (i < 0 || args.size() < i + 3)
+            return { 1, "usage: --renew <ledger.csv> <out> [--date=YYYYMMDD] [--scheme=v1|v2]" };
+
+        const auto ledger = cwd.getChildFile(args[i + 1]);
+        const auto output = cwd.getChildFile(args[i + 2]);
+        if (! ledger.existsAsFile())
+            return { 1, "ledger not found: " + ledger.getFullPathName() };
+
+        const auto date = optionValue(args, "--date", license::currentDate());
+        if (date.length() != 8 || ! date.containsOnly("0123456789"))
+            return { 1, "--date must be YYYYMMDD" };
+
+        license::Scheme scheme;
+        if (! commands::schemeOption(args, scheme))
+            return { 1, "--scheme must be v1 or v2" };
+
+        Summary summary;
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        const auto r = renewLedger(ledger, output, date.toStdString(), summary, scheme);
+        if (r.failed())
+            return { 1, r.getErrorMessage() };
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+        juce::String text;
+        text << summary.renewed << " licenses renewed for " << date
+             << " in " << juce::String(seconds, 2) << " s\n"
+             << summary.duplicates << " duplicate rows, "
+             << summary.unverified << " rows whose key does not verify, "
+             << summary.malformed << " malformed rows skipped";
+        return { 0, text };
+    }
+} // namespace renew
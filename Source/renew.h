@@ -0,0 +1,41 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+#include "license.h"
+#include <string>
+
+/*
+    Bulk renewal of every customer in a ledger.
+
+        --renew <ledger.csv> <out> [--date=YYYYMMDD] [--scheme=v1|v2]
+
+    The ledger is streamed in 8 MB chunks and each chunk is signed across the
+    worker pool with license::IdentitySigner: the secret and the customer's
+    "first|last|email|Vn|" prefix are hashed once, only for the schemes in
+    play, and both checking the current keys and signing the new date finish
+    from that midstate. The ledger keeps every key ever handed out, so each
+    identity is renewed once: a first pass collects the ledger's identities
+    into a compressed identities::IdentityStore and the second, over the same
+    bytes, groups each chunk's rows by identity, signs only the first row of
+    each that verifies, and marks one bit per identity as it is renewed. Rows appended meanwhile wait for the
+    next renewal. Rows whose current key no longer verifies are skipped and
+    counted. The output extension picks the sink format.
+*/
+namespace renew
+{
+    struct Summary
+    {
+        juce::int64 renewed = 0;
+        juce::int64 duplicates = 0;
+        juce::int64 unverified = 0;
+        juce::int64 malformed = 0;
+    };
+
+    juce::Result renewLedger(const juce::File& ledger, const juce::File& output,
+                             const std::string& yyyymmdd, Summary& summary,
+                             license::Scheme scheme = license::kIssueScheme);
+
+    bool handles(const juce::StringArray& args);
+    commands::Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+} // namespace renew
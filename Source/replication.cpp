@@ -0,0 +1,346 @@
+#include "replication.h"
+#include "batch.h"
+#include "crypto_small.h"
+#include "trace.h"
+
+#include <map>
+
+namespace replication
+{
+    namespace
+    {
+        constexpr juce::int64 kSegmentBytes = 4 * 1024 * 1024;
+        constexpr const char* kGlobalHeader = "Station,Seq,First,Last,Email,GeneratedAt,License\n";
+
+        juce::File segmentDirectory(const juce::File& directory)
+        {
+            return directory.getChildFile("ledger-segments");
+        }
+
+        juce::File segmentFile(const juce::File& directory, int index)
+        {
+            return segmentDirectory(directory).getChildFile("segment-" + juce::String(index).paddedLeft('0', 6) + ".csv");
+        }
+
+        juce::StringPairArray readKeyValues(const juce::File& file)
+        {
+            juce::StringArray lines;
+            file.readLines(lines);
+
+            juce::StringPairArray values;
+            for (const auto& line : lines)
+            {
+                const auto eq = line.indexOfChar('=');
+                if (eq > 0)
+                    values.set(line.substring(0, eq), line.substring(eq + 1));
+            }
+            return values;
+        }
+
+        juce::String sha256Hex(const void* data, size_t size)
+        {
+            crypto_small::Sha256Context ctx;
+            ctx.update(static_cast<const uint8_t*>(data), size);
+            const auto digest = ctx.digest();
+            return juce::String::toHexString(digest.data(), static_cast<int>(digest.size()), 0);
+        }
+
+        struct Segment
+        {
+            juce::int64 records = 0;
+            juce::int64 bytes = 0;
+            juce::String sha256;
+        };
+
+        struct Index
+        {
+            juce::String station;
+            juce::int64 exportedBytes = 0;
+            std::vector<Segment> segments;
+        };
+
+        Index loadIndex(const juce::File& directory)
+        {
+            Index index;
+            const auto file = segmentDirectory(directory).getChildFile("index.txt");
+            if (! file.existsAsFile())
+                return index;
+
+            const auto values = readKeyValues(file);
+            index.station = values["station"];
+            index.exportedBytes = values["exported"].getLargeIntValue();
+
+            const int count = values["segments"].getIntValue();
+            for (int i = 1; i <= count; ++i)
+            {
+                const auto parts = juce::StringArray::fromTokens(values["segment." + juce::String(i)], " ", "");
+                if (parts.size() != 3)
+                    break;
+                index.segments.push_back({ parts[0].getLargeIntValue(), parts[1].getLargeIntValue(), parts[2] });
+            }
+            return index;
+        }
+
+        bool saveIndex(const juce::File& directory, const Index& index)
+        {
+            juce::String text;
+            text << "station=" << index.station << '\n'
+                 << "exported=" << index.exportedBytes << '\n'
+                 << "segments=" << static_cast<int>(index.segments.size()) << '\n';
+            for (size_t i = 0; i < index.segments.size(); ++i)
+            {
+                const auto& s = index.segments[i];
+                text << "segment." << static_cast<int>(i + 1) << '=' << s.records << ' ' << s.bytes << ' ' << s.sha256 << '\n';
+            }
+            return segmentDirectory(directory).getChildFile("index.txt").replaceWithText(text);
+        }
+
+        // Per-station progress of one global ledger.
+        struct SyncState
+        {
+            juce::int64 globalBytes = 0;
+            std::map<juce::String, std::pair<int, juce::int64>> applied;  // station -> (last segment, last seq)
+        };
+
+        juce::File stateFileFor(const juce::File& globalLedger)
+        {
+            return globalLedger.getSiblingFile(globalLedger.getFileName() + ".sync");
+        }
+
+        SyncState loadState(const juce::File& globalLedger)
+        {
+            SyncState state;
+            const auto values = readKeyValues(stateFileFor(globalLedger));
+            state.globalBytes = values["size"].getLargeIntValue();
+
+            for (const auto& key : values.getAllKeys())
+            {
+                if (! key.startsWith("station."))
+                    continue;
+                const auto parts = juce::StringArray::fromTokens(values[key], " ", "");
+                if (parts.size() == 2)
+                    state.applied[key.fromFirstOccurrenceOf("station.", false, false)] = { parts[0].getIntValue(), parts[1].getLargeIntValue() };
+            }
+            return state;
+        }
+
+        bool saveState(const juce::File& globalLedger, const SyncState& state)
+        {
+            juce::String text;
+            text << "size=" << state.globalBytes << '\n';
+            for (const auto& [station, progress] : state.applied)
+                text << "station." << station << '=' << progress.first << ' ' << progress.second << '\n';
+            return stateFileFor(globalLedger).replaceWithText(text);
+        }
+    }
+
+    juce::String stationId(const juce::File& directory)
+    {
+        const auto file = directory.getChildFile(".station-id");
+        auto id = file.loadFileAsString().trim();
+        if (id.isEmpty())
+        {
+            id = juce::Uuid().toString().substring(0, 16);
+            file.replaceWithText(id + "\n");
+        }
+        return id;
+    }
+
+    juce::Result publish(const juce::File& directory, PublishSummary& summary)
+    {
+        SMK_TRACE_SCOPE("publishLedger");
+
+        const auto ledger = batch::defaultLedgerFile(directory);
+        if (! ledger.existsAsFile())
+            return juce::Result::ok();
+
+        if (auto r = segmentDirectory(directory).createDirectory(); r.failed())
+            return r;
+
+        auto index = loadIndex(directory);
+        index.station = stationId(directory);
+
+        const auto ledgerSize = ledger.getSize();
+        if (ledgerSize < index.exportedBytes)
+            return juce::Result::fail("ledger is shorter than what was already published: " + ledger.getFullPathName());
+
+        juce::FileInputStream in(ledger);
+        if (! in.openedOk() || ! in.setPosition(index.exportedBytes))
+            return juce::Result::fail("failed to read " + ledger.getFullPathName());
+
+        juce::MemoryBlock pending;
+        juce::int64 remaining = ledgerSize - index.exportedBytes;
+
+        while (remaining > 0)
+        {
+            const auto want = static_cast<size_t>(juce::jmin(remaining, kSegmentBytes));
+            const auto keep = pending.getSize();
+            pending.setSize(keep + want);
+            const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(want));
+            if (got <= 0)
+                break;
+            pending.setSize(keep + static_cast<size_t>(got));
+            remaining -= got;
+
+            // Only whole records; a line still being written waits for next time.
+            const auto* data = static_cast<const char*>(pending.getData());
+            size_t cut = pending.getSize();
+            while (cut > 0 && data[cut - 1] != '\n')
+                --cut;
+            if (cut == 0)
+                continue;
+
+            juce::StringArray lines;
+            lines.addLines(juce::String::fromUTF8(data, static_cast<int>(cut)));
+
+            juce::String body;
+            juce::int64 records = 0;
+            for (int i = 0; i < lines.size(); ++i)
+            {
+                if (lines[i].trim().isEmpty())
+                    continue;
+                if (index.exportedBytes == 0 && i == 0 && lines[i].startsWithIgnoreCase("first,"))
+                    continue;
+                body << lines[i] << '\n';
+                ++records;
+            }
+
+            if (records > 0)
+            {
+                const auto segmentIndex = static_cast<int>(index.segments.size()) + 1;
+                const auto utf8 = body.toRawUTF8();
+                const auto bytes = body.getNumBytesAsUTF8();
+                if (! segmentFile(directory, segmentIndex).replaceWithData(utf8, bytes))
+                    return juce::Result::fail("failed to write segment " + juce::String(segmentIndex));
+
+                index.segments.push_back({ records, static_cast<juce::int64>(bytes), sha256Hex(utf8, bytes) });
+                ++summary.segments;
+                summary.records += records;
+            }
+
+            index.exportedBytes += static_cast<juce::int64>(cut);
+            pending.removeSection(0, cut);
+
+            // The segment is on disk before the index mentions it.
+            if (! saveIndex(directory, index))
+                return juce::Result::fail("failed to write segment index");
+        }
+
+        return juce::Result::ok();
+    }
+
+    juce::Result sync(const juce::File& globalLedger, const juce::Array<juce::File>& peers, SyncSummary& summary)
+    {
+        SMK_TRACE_SCOPE("syncLedger");
+
+        // Without its state file there is no telling what a global ledger
+        // holds, and rolling back to size 0 would wipe it.
+        const bool hasState = stateFileFor(globalLedger).existsAsFile();
+        if (! hasState && globalLedger.getSize() > 0)
+            return juce::Result::fail(globalLedger.getFullPathName() + " is not empty and has no "
+                                      + stateFileFor(globalLedger).getFileName() + "; refusing to append to it");
+
+        auto state = loadState(globalLedger);
+        if (globalLedger.getSize() < state.globalBytes)
+            return juce::Result::fail(globalLedger.getFullPathName() + " is shorter than its recorded size");
+
+        juce::FileOutputStream out(globalLedger);
+        if (! out.openedOk())
+            return juce::Result::fail("failed to write " + globalLedger.getFullPathName());
+
+        // Drop anything appended by a sync that died before recording it.
+        if (hasState && out.getPosition() > state.globalBytes)
+            if (! out.setPosition(state.globalBytes) || out.truncate().failed())
+                return juce::Result::fail("failed to roll back " + globalLedger.getFullPathName());
+
+        if (state.globalBytes == 0)
+            out << kGlobalHeader;
+
+        for (const auto& peer : peers)
+        {
+            const auto index = loadIndex(peer);
+            if (index.station.isEmpty())
+                return juce::Result::fail("no published ledger in " + peer.getFullPathName());
+
+            auto& [lastSegment, lastSeq] = state.applied[index.station];
+
+            for (int s = lastSegment + 1; s <= static_cast<int>(index.segments.size()); ++s)
+            {
+                const auto& expected = index.segments[static_cast<size_t>(s - 1)];
+
+                juce::MemoryBlock data;
+                if (! segmentFile(peer, s).loadFileAsData(data)
+                    || static_cast<juce::int64>(data.getSize()) != expected.bytes
+                    || sha256Hex(data.getData(), data.getSize()) != expected.sha256)
+                    return juce::Result::fail("segment " + juce::String(s) + " from " + peer.getFullPathName() + " is missing or corrupt");
+
+                juce::StringArray lines;
+                lines.addLines(juce::String::fromUTF8(static_cast<const char*>(data.getData()), static_cast<int>(data.getSize())));
+
+                for (const auto& line : lines)
+                {
+                    if (line.trim().isEmpty())
+                        continue;
+                    out << batch::escapeCsvField(index.station) << ',' << ++lastSeq << ',' << line << '\n';
+                }
+
+                out.flush();
+                if (out.getStatus().failed())
+                    return out.getStatus();
+
+                lastSegment = s;
+                state.globalBytes = out.getPosition();
+                if (! saveState(globalLedger, state))
+                    return juce::Result::fail("failed to record sync progress");
+
+                ++summary.segments;
+                summary.records += expected.records;
+            }
+        }
+
+        out.flush();
+        state.globalBytes = out.getPosition();
+        if (! saveState(globalLedger, state))
+            return juce::Result::fail("failed to record sync progress");
+
+        return juce::Result::ok();
+    }
+
+    bool handles(const juce::StringArray& args)
+    {
+        return args.contains("--ledger-publish") || args.contains("--ledger-sync");
+    }
+
+    commands::Result run(const juce::StringArray& args, const juce::File& cwd)
+    {
+        if (const int i = args.indexOf("--ledger-publish"); i >= 0)
+        {
+            const auto directory = args.size() > i + 1 && ! args[i + 1].startsWith("--") ? cwd.getChildFile(args[i + 1]) : cwd;
+
+            PublishSummary summary;
+            if (const auto r = publish(directory, summary); r.failed())
+                return { 1, r.getErrorMessage() };
+
+            juce::String text;
+            text << "Station " << stationId(directory) << ": " << summary.records << " records in "
+                 << summary.segments << " new segments.";
+            return { 0, text };
+        }
+
+        const int i = args.indexOf("--ledger-sync");
+        if (i < 0 || args.size() < i + 3)
+            return { 1, "usage: --ledger-sync <global.csv> <peer-dir>..." };
+
+        juce::Array<juce::File> peers;
+        for (int p = i + 2; p < args.size() && ! args[p].startsWith("--"); ++p)
+            peers.add(cwd.getChildFile(args[p]));
+
+        SyncSummary summary;
+        if (const auto r = sync(cwd.getChildFile(args[i + 1]), peers, summary); r.failed())
+            return { 1, r.getErrorMessage() };
+
+        juce::String text;
+        text << summary.records << " records from " << summary.segments << " new segments applied.";
+        return { 0, text };
+    }
+} // namespace replication
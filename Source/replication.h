@@ -0,0 +1,48 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+#include <vector>
+
+/*
+    Log-shipping replication of the license ledger between stations.
+
+    publish() cuts whatever the local ledger gained since the last publish
+    into numbered segment files under <dir>/ledger-segments, each listed in
+    index.txt with its record count, size and SHA-256, next to the
+    station's id. The ledger itself is never rewritten.
+
+    sync() reads each peer's index, fetches only segments past the last one
+    it applied from that station, checks them and appends their records to
+    a global ledger as Station,Seq,First,Last,Email,GeneratedAt,License,
+    where Seq numbers a station's records from 1. Progress lives in
+    <global>.sync; a sync that died half-way is rolled back to the last
+    recorded size first, so (station, seq) never appears twice. A non-empty
+    global ledger without its .sync file is refused rather than truncated.
+
+        --ledger-publish [<dir>]
+        --ledger-sync <global.csv> <peer-dir>...
+*/
+namespace replication
+{
+    struct PublishSummary
+    {
+        int segments = 0;
+        juce::int64 records = 0;
+    };
+
+    struct SyncSummary
+    {
+        int segments = 0;
+        juce::int64 records = 0;
+    };
+
+    // The station's id, created in directory on first use.
+    juce::String stationId(const juce::File& directory);
+
+    juce::Result publish(const juce::File& directory, PublishSummary& summary);
+    juce::Result sync(const juce::File& globalLedger, const juce::Array<juce::File>& peers, SyncSummary& summary);
+
+    bool handles(const juce::StringArray& args);
+    commands::Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+} // namespace replication
@@ -0,0 +1,272 @@
+#include "resident.h"
+
+#include <random>
+
+#if ! JUCE_WINDOWS
+ #include <sys/stat.h>
+#endif
+
+namespace resident
+{
+    namespace
+    {
+        constexpr int kConnectTimeoutMs = 250;
+
+        const char* const kForwardable[] = { "--issue", "--verify", "--batch", "--renew" };
+
+        juce::File tokenFile()
+        {
+            return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                       .getChildFile("SM-Keygen")
+                       .getChildFile("resident.token");
+        }
+
+        juce::String makeToken()
+        {
+            std::random_device device;
+            juce::String token;
+            for (int i = 0; i < 8; ++i)
+                token << juce::String::toHexString(static_cast<juce::int64>(device())).paddedLeft('0', 8);
+            return token;
+        }
+
+        // Created empty and narrowed to 0600 before the token goes in, and
+        // written in place so the permissions survive.
+        bool writeToken(const juce::File& file, const juce::String& token)
+        {
+            if (file.getParentDirectory().createDirectory().failed())
+                return false;
+
+            file.deleteFile();
+            if (file.create().failed())
+                return false;
+
+           #if ! JUCE_WINDOWS
+            if (::chmod(file.getFullPathName().toRawUTF8(), S_IRUSR | S_IWUSR) != 0)
+                return false;
+           #endif
+
+            juce::FileOutputStream out(file);
+            if (! out.openedOk())
+                return false;
+
+            out.setPosition(0);
+            out.truncate();
+            out.writeText(token, false, false, nullptr);
+            out.flush();
+            return out.getStatus().wasOk();
+        }
+
+        bool tokensMatch(const juce::String& a, const juce::String& b) noexcept
+        {
+            const auto* x = a.toRawUTF8();
+            const auto* y = b.toRawUTF8();
+            const auto n = a.getNumBytesAsUTF8();
+            if (n != b.getNumBytesAsUTF8() || n == 0)
+                return false;
+
+            unsigned char diff = 0;
+            for (size_t i = 0; i < n; ++i)
+                diff |= static_cast<unsigned char>(x[i] ^ y[i]);
+            return diff == 0;
+        }
+
+        juce::MemoryBlock encodeRequest(const juce::String& token, const juce::StringArray& args,
+                                        const juce::File& workingDirectory)
+        {
+            juce::MemoryOutputStream out;
+            out.writeString(token);
+            out.writeString(workingDirectory.getFullPathName());
+            out.writeInt(args.size());
+            for (const auto& arg : args)
+                out.writeString(arg);
+            return out.getMemoryBlock();
+        }
+
+        bool decodeRequest(const juce::MemoryBlock& block, const juce::String& token,
+                           juce::StringArray& args, juce::File& workingDirectory)
+        {
+            juce::MemoryInputStream in(block, false);
+            if (! tokensMatch(in.readString(), token))
+                return false;
+
+            const auto cwd = in.readString();
+            if (! juce::File::isAbsolutePath(cwd))
+                return false;
+
+            workingDirectory = juce::File(cwd);
+            const int count = in.readInt();
+            if (count < 0 || count > 1024)
+                return false;
+
+            for (int i = 0; i < count && ! in.isExhausted(); ++i)
+                args.add(in.readString());
+
+            return args.size() == count;
+        }
+
+        juce::MemoryBlock encodeResult(const commands::Result& result)
+        {
+            juce::MemoryOutputStream out;
+            out.writeInt(result.exitCode);
+            out.writeString(result.output);
+            return out.getMemoryBlock();
+        }
+
+        commands::Result decodeResult(const juce::MemoryBlock& block)
+        {
+            juce::MemoryInputStream in(block, false);
+            commands::Result result;
+            result.exitCode = in.readInt();
+            result.output = in.readString();
+            return result;
+        }
+
+        // Server side of one client call. Commands run on the connection's own
+        // thread so a long --batch never blocks the message thread.
+        class ClientConnection : public juce::InterprocessConnection
+        {
+        public:
+            explicit ClientConnection(const juce::String& serverToken)
+                : juce::InterprocessConnection(false), token(serverToken) {}
+            ~ClientConnection() override { disconnect(); }
+
+            bool isFinished() const noexcept { return finished.load(); }
+
+            void connectionMade() override {}
+            void connectionLost() override { finished = true; }
+
+            void messageReceived(const juce::MemoryBlock& message) override
+            {
+                juce::StringArray args;
+                juce::File cwd;
+                commands::Result result;
+
+                if (! decodeRequest(message, token, args, cwd))
+                    result = { 1, "malformed or unauthorised request" };
+                else if (! isForwardable(args))
+                    result = { 1, "command not accepted by the resident instance" };
+                else
+                    result = commands::run(args, cwd);
+
+                sendMessage(encodeResult(result));
+            }
+
+        private:
+            const juce::String token;
+            std::atomic<bool> finished { false };
+        };
+
+        // Client side: waits for the single reply to its request.
+        class ReplyConnection : public juce::InterprocessConnection
+        {
+        public:
+            ReplyConnection() : juce::InterprocessConnection(false) {}
+            ~ReplyConnection() override { disconnect(); }
+
+            void connectionMade() override {}
+            void connectionLost() override { replied.signal(); }
+
+            void messageReceived(const juce::MemoryBlock& message) override
+            {
+                reply = message;
+                gotReply = true;
+                replied.signal();
+            }
+
+            bool waitForReply(int timeoutMs) { return replied.wait(timeoutMs) && gotReply; }
+            const juce::MemoryBlock& getReply() const noexcept { return reply; }
+
+        private:
+            juce::WaitableEvent replied;
+            juce::MemoryBlock reply;
+            std::atomic<bool> gotReply { false };
+        };
+    }
+
+    struct Server::Impl : public juce::InterprocessConnectionServer
+    {
+        ~Impl() override
+        {
+            stop();
+            const juce::ScopedLock sl(lock);
+            connections.clear();
+
+            // Leave a newer instance's token alone.
+            if (token.isNotEmpty() && tokenFile().loadFileAsString() == token)
+                tokenFile().deleteFile();
+        }
+
+        juce::InterprocessConnection* createConnectionObject() override
+        {
+            const juce::ScopedLock sl(lock);
+
+            for (int i = connections.size(); --i >= 0;)
+                if (connections[i]->isFinished())
+                    connections.remove(i);
+
+            return connections.add(new ClientConnection(token));
+        }
+
+        juce::String token;
+        juce::CriticalSection lock;
+        juce::OwnedArray<ClientConnection> connections;
+    };
+
+    Server::Server() : impl(std::make_unique<Impl>()) {}
+    Server::~Server() = default;
+
+    bool Server::start()
+    {
+        // Set before listening, so no connection is ever made with an empty token.
+        impl->token = makeToken();
+        if (impl->beginWaitingForSocket(kPort, "127.0.0.1") && writeToken(tokenFile(), impl->token))
+            return true;
+
+        impl->stop();
+        impl->token = {};
+        return false;
+    }
+
+    bool isForwardable(const juce::StringArray& args)
+    {
+        // Exactly one allowed command, and nothing else commands::run would pick first.
+        juce::StringArray rest(args);
+        int allowed = 0;
+        for (const auto* name : kForwardable)
+            if (rest.contains(name))
+            {
+                rest.removeString(name);
+                ++allowed;
+            }
+
+        return allowed == 1 && ! commands::isHeadless(rest);
+    }
+
+    bool forward(const juce::StringArray& args,
+                 const juce::File& workingDirectory,
+                 commands::Result& result,
+                 int replyTimeoutMs)
+    {
+        if (! isForwardable(args))
+            return false;
+
+        const auto token = tokenFile().loadFileAsString().trim();
+        if (token.isEmpty())
+            return false;
+
+        ReplyConnection connection;
+        if (! connection.connectToSocket("127.0.0.1", kPort, kConnectTimeoutMs))
+            return false;
+
+        if (! connection.sendMessage(encodeRequest(token, args, workingDirectory)))
+            return false;
+
+        if (connection.waitForReply(replyTimeoutMs))
+            result = decodeResult(connection.getReply());
+        else
+            result = { 1, "resident instance did not reply" };
+
+        return true;
+    }
+} // namespace resident
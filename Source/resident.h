@@ -0,0 +1,53 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+#include <memory>
+
+/*
+    Warm resident instance.
+
+    A running SM-Keygen (the GUI, or one started with --resident and no
+    window) listens on a loopback socket. A later launch with a headless
+    command forwards its arguments and working directory there and prints the
+    reply, so scripted calls skip the cold start of a fresh process doing the
+    work itself. If nothing is listening the caller runs the command locally.
+
+    The socket is reachable by every local user, so each request carries a
+    random token the server writes to resident.token in the user's
+    application data folder (owner-only permissions; the profile ACL covers
+    it on Windows). Only --issue, --verify, --batch and --renew are
+    forwarded; anything else runs in the calling process.
+*/
+namespace resident
+{
+    constexpr int kPort = 47519;
+
+    class Server
+    {
+    public:
+        Server();
+        ~Server();
+
+        // Returns false if another instance already owns the port or the
+        // token file can't be written.
+        bool start();
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+
+        JUCE_DECLARE_NON_COPYABLE (Server)
+    };
+
+    // True for the commands a resident instance will run on a client's behalf.
+    bool isForwardable(const juce::StringArray& args);
+
+    // Sends the command to a resident instance. Returns false if the command
+    // isn't forwardable or none is running (or its token can't be read), in
+    // which case result is left untouched.
+    bool forward(const juce::StringArray& args,
+                 const juce::File& workingDirectory,
+                 commands::Result& result,
+                 int replyTimeoutMs = 10 * 60 * 1000);
+} // namespace resident
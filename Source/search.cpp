@@ -0,0 +1,314 @@
+#include "search.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace search
+{
+    namespace
+    {
+        constexpr char kSeparator = '\x1f';
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+
+        void appendNormalized(std::string& out, const juce::String& field)
+        {
+            const auto lower = field.trim().toLowerCase();
+            out.append(lower.toRawUTF8(), lower.getNumBytesAsUTF8());
+        }
+
+        uint32_t trigramAt(const char* p) noexcept
+        {
+            return (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 16)
+                 | (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 8)
+                 | static_cast<uint32_t>(static_cast<uint8_t>(p[2]));
+        }
+
+        // Distinct trigrams of text, leaving out any that span a field separator.
+        std::vector<uint32_t> trigramsOf(std::string_view text)
+        {
+            std::vector<uint32_t> grams;
+            if (text.size() < 3)
+                return grams;
+
+            grams.reserve(text.size() - 2);
+            for (size_t i = 0; i + 3 <= text.size(); ++i)
+                if (text[i] != kSeparator && text[i + 1] != kSeparator && text[i + 2] != kSeparator)
+                    grams.push_back(trigramAt(text.data() + i));
+
+            std::sort(grams.begin(), grams.end());
+            grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+            return grams;
+        }
+
+        std::vector<std::string> termsOf(const juce::String& text)
+        {
+            std::vector<std::string> terms;
+            for (const auto& token : juce::StringArray::fromTokens(text.toLowerCase(), " \t", ""))
+                if (token.isNotEmpty())
+                    terms.push_back(token.toStdString());
+
+            // Longest first: it is the most selective.
+            std::sort(terms.begin(), terms.end(), [](const auto& a, const auto& b) { return a.size() > b.size(); });
+            return terms;
+        }
+    }
+
+    LedgerIndex::LedgerIndex(const juce::File& ledger)
+        : ledgerFile(ledger)
+    {
+    }
+
+    LedgerIndex::~LedgerIndex()
+    {
+        batch::removeLedgerListener(this);
+    }
+
+    juce::Result LedgerIndex::load()
+    {
+        SMK_TRACE_SCOPE("loadLedgerIndex");
+
+        // Everything up to this size is read here; anything later comes
+        // through ledgerRecordAppended.
+        const auto sizeAtStart = batch::addLedgerListener(this, ledgerFile);
+
+        // Unregistered on failure, or appends would queue up forever behind a
+        // load that never finishes.
+        auto fail = [this]
+        {
+            batch::removeLedgerListener(this);
+            const std::unique_lock<std::shared_mutex> lock(mutex);
+            appendedWhileLoading.clear();
+            return juce::Result::fail("failed to read " + ledgerFile.getFullPathName());
+        };
+
+        if (sizeAtStart > 0)
+        {
+            juce::FileInputStream in(ledgerFile);
+            if (! in.openedOk())
+                return fail();
+
+            juce::MemoryBlock pending;
+            juce::int64 remaining = sizeAtStart;
+            bool atFileStart = true;
+
+            while (remaining > 0)
+            {
+                const auto want = static_cast<size_t>(juce::jmin(remaining, kChunkBytes));
+                const auto keep = pending.getSize();
+                pending.setSize(keep + want);
+                const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(want));
+                if (got <= 0)
+                    return fail();
+
+                pending.setSize(keep + static_cast<size_t>(got));
+                remaining -= got;
+
+                const auto* data = static_cast<const char*>(pending.getData());
+                size_t cut = pending.getSize();
+                if (remaining > 0)
+                    while (cut > 0 && data[cut - 1] != '\n')
+                        --cut;
+
+                juce::StringArray lines;
+                lines.addLines(juce::String::fromUTF8(data, static_cast<int>(cut)));
+                pending.removeSection(0, cut);
+
+                Rows chunk;
+                for (int i = 0; i < lines.size(); ++i)
+                {
+                    if (atFileStart && i == 0 && lines[i].startsWithIgnoreCase("first,"))
+                        continue;
+
+                    const auto fields = batch::splitCsvLine(lines[i]);
+                    if (fields.size() >= 5)
+                        chunk.add(fields);
+                }
+                atFileStart = false;
+
+                const std::unique_lock<std::shared_mutex> lock(mutex);
+                rows.append(chunk);
+            }
+        }
+
+        const std::unique_lock<std::shared_mutex> lock(mutex);
+        for (const auto& fields : appendedWhileLoading)
+            rows.add(fields);
+        appendedWhileLoading.clear();
+        loaded = true;
+
+        return juce::Result::ok();
+    }
+
+    void LedgerIndex::ledgerRecordAppended(const juce::File& ledger, const juce::StringArray& fields)
+    {
+        if (ledger != ledgerFile)
+            return;
+
+        // Called under batch::ledgerLock, so the row is indexed before taking ours.
+        Rows row;
+        row.add(fields);
+
+        const std::unique_lock<std::shared_mutex> lock(mutex);
+        if (loaded)
+            rows.append(row);
+        else
+            appendedWhileLoading.push_back(fields);
+    }
+
+    void LedgerIndex::Rows::add(const juce::StringArray& fields)
+    {
+        const auto row = size();
+
+        for (int i = 0; i < 5; ++i)
+        {
+            if (i != 0)
+                display.push_back(kSeparator);
+            display.append(fields[i].toRawUTF8(), fields[i].getNumBytesAsUTF8());
+        }
+        displayOffsets.push_back(display.size());
+
+        const auto start = normalized.size();
+        for (const int i : { 0, 1, 2, 4 })
+        {
+            if (i != 0)
+                normalized.push_back(kSeparator);
+            appendNormalized(normalized, fields[i]);
+        }
+        normalizedOffsets.push_back(normalized.size());
+
+        for (const auto gram : trigramsOf(std::string_view(normalized).substr(start)))
+            postings[gram].push_back(row);
+    }
+
+    void LedgerIndex::Rows::append(const Rows& other)
+    {
+        // Other's rows all come after ours, so shifted postings stay ascending.
+        const auto base = size();
+
+        const auto displayBase = display.size();
+        display += other.display;
+        for (size_t i = 1; i < other.displayOffsets.size(); ++i)
+            displayOffsets.push_back(displayBase + other.displayOffsets[i]);
+
+        const auto normalizedBase = normalized.size();
+        normalized += other.normalized;
+        for (size_t i = 1; i < other.normalizedOffsets.size(); ++i)
+            normalizedOffsets.push_back(normalizedBase + other.normalizedOffsets[i]);
+
+        for (const auto& [gram, list] : other.postings)
+        {
+            auto& into = postings[gram];
+            into.reserve(into.size() + list.size());
+            for (const auto row : list)
+                into.push_back(base + row);
+        }
+    }
+
+    std::string_view LedgerIndex::normalizedRow(uint32_t row) const
+    {
+        return std::string_view(rows.normalized).substr(rows.normalizedOffsets[row],
+                                                        rows.normalizedOffsets[row + 1] - rows.normalizedOffsets[row]);
+    }
+
+    std::vector<uint32_t> LedgerIndex::query(const juce::String& text, size_t limit, bool& truncated) const
+    {
+        SMK_TRACE_SCOPE("queryLedgerIndex");
+
+        truncated = false;
+        std::vector<uint32_t> matches;
+
+        const auto terms = termsOf(text);
+        if (terms.empty() || limit == 0)
+            return matches;
+
+        const std::shared_lock<std::shared_mutex> lock(mutex);
+
+        auto matchesAll = [&](uint32_t row)
+        {
+            const auto haystack = normalizedRow(row);
+            return std::all_of(terms.begin(), terms.end(), [&](const std::string& t) { return haystack.find(t) != std::string_view::npos; });
+        };
+
+        auto accept = [&](uint32_t row)
+        {
+            if (! matchesAll(row))
+                return true;
+            if (matches.size() == limit)
+            {
+                truncated = true;
+                return false;
+            }
+            matches.push_back(row);
+            return true;
+        };
+
+        const auto grams = trigramsOf(terms.front());
+        if (grams.empty())
+        {
+            // Nothing to look up for a one- or two-byte term: scan, newest first.
+            for (auto row = rows.size(); row-- > 0;)
+                if (! accept(row))
+                    break;
+            return matches;
+        }
+
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (const auto gram : grams)
+        {
+            const auto it = rows.postings.find(gram);
+            if (it == rows.postings.end())
+                return matches;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+
+        // Intersect while it still narrows things down; the substring check
+        // settles the rest.
+        std::vector<uint32_t> candidates = *lists.front();
+        std::vector<uint32_t> narrowed;
+        for (size_t i = 1; i < lists.size() && candidates.size() > 256; ++i)
+        {
+            narrowed.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                                  std::back_inserter(narrowed));
+            candidates.swap(narrowed);
+        }
+
+        for (auto it = candidates.rbegin(); it != candidates.rend(); ++it)
+            if (! accept(*it))
+                break;
+
+        return matches;
+    }
+
+    size_t LedgerIndex::size() const
+    {
+        const std::shared_lock<std::shared_mutex> lock(mutex);
+        return rows.size();
+    }
+
+    Record LedgerIndex::record(uint32_t row) const
+    {
+        const std::shared_lock<std::shared_mutex> lock(mutex);
+        if (row >= rows.size())
+            return {};
+
+        std::string_view rest = std::string_view(rows.display).substr(rows.displayOffsets[row],
+                                                                      rows.displayOffsets[row + 1] - rows.displayOffsets[row]);
+        juce::String fields[5];
+        for (auto& field : fields)
+        {
+            const auto end = std::min(rest.find(kSeparator), rest.size());
+            field = juce::String::fromUTF8(rest.data(), static_cast<int>(end));
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+        }
+
+        Record r;
+        r.first = fields[0];
+        r.last = fields[1];
+        r.email = fields[2];
+        r.generatedAt = fields[3];
+        r.license = fields[4];
+        return r;
+    }
+} // namespace search
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "batch.h"
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Substring search over the license ledger.
+
+    Every record's first, last, email and license are lower-cased into one
+    arena, and each distinct byte trigram in them maps to the ascending list
+    of rows containing it. A query term of three or more bytes intersects the
+    posting lists of its trigrams, starting from the shortest, and confirms
+    the few survivors with a plain substring check; shorter terms fall back
+    to a scan. The index follows appendLicenseRecord through a ledger
+    listener, so rows issued in this process while it is open show up
+    immediately. Rows appended by another process (a CLI --issue --local, or
+    the resident server) only show up after the index is loaded again.
+
+    load() indexes each 8 MB chunk of the ledger without holding the lock and
+    only takes it to merge the chunk in, so queries and appends from other
+    threads wait for a merge, never for the parsing.
+*/
+namespace search
+{
+    struct Record
+    {
+        juce::String first;
+        juce::String last;
+        juce::String email;
+        juce::String generatedAt;
+        juce::String license;
+    };
+
+    class LedgerIndex : private batch::LedgerListener
+    {
+    public:
+        explicit LedgerIndex(const juce::File& ledger);
+        ~LedgerIndex() override;
+
+        // Reads the ledger as it stands; later appends arrive on their own.
+        // After a failure the index stays empty and unsubscribed; make a new
+        // one to try again.
+        juce::Result load();
+
+        // Rows containing every whitespace-separated term of text in one of
+        // their fields, case-insensitively, newest first. Stops after limit
+        // matches and sets truncated when there were more.
+        std::vector<uint32_t> query(const juce::String& text, size_t limit, bool& truncated) const;
+
+        size_t size() const;
+        Record record(uint32_t row) const;
+
+    private:
+        // Indexed rows. Built up a chunk at a time off the lock, then appended.
+        struct Rows
+        {
+            std::string display;        // original fields, '\x1f' separated
+            std::vector<size_t> displayOffsets { 0 };
+            std::string normalized;     // lower-cased first, last, email, license
+            std::vector<size_t> normalizedOffsets { 0 };
+            std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+            uint32_t size() const noexcept { return static_cast<uint32_t>(displayOffsets.size() - 1); }
+            void add(const juce::StringArray& fields);
+            void append(const Rows& other);
+        };
+
+        void ledgerRecordAppended(const juce::File& ledger, const juce::StringArray& fields) override;
+        std::string_view normalizedRow(uint32_t row) const;
+
+        const juce::File ledgerFile;
+
+        mutable std::shared_mutex mutex;
+        bool loaded = false;
+        std::vector<juce::StringArray> appendedWhileLoading;
+        Rows rows;
+    };
+} // namespace search
@@ -0,0 +1,402 @@
+#include "shard.h"
+#include "batch.h"
+#include "crypto_small.h"
+#include "license.h"
+#include "trace.h"
+
+namespace shard
+{
+    namespace
+    {
+        constexpr juce::int64 kChunkBytes = 8 * 1024 * 1024;
+
+        juce::String toHex(const uint8_t* data, size_t len)
+        {
+            return juce::String::toHexString(data, static_cast<int>(len), 0);
+        }
+
+        juce::String finalHex(crypto_small::detail::Sha256Context& ctx)
+        {
+            uint8_t digest[32];
+            crypto_small::detail::sha256Final(ctx, digest);
+            return toHex(digest, sizeof(digest));
+        }
+
+        juce::StringPairArray readKeyValues(const juce::File& file)
+        {
+            juce::StringArray lines;
+            file.readLines(lines);
+
+            juce::StringPairArray values;
+            for (const auto& line : lines)
+            {
+                const auto eq = line.indexOfChar('=');
+                if (eq > 0)
+                    values.set(line.substring(0, eq), line.substring(eq + 1));
+            }
+            return values;
+        }
+
+        // Offset just past the first newline at or after position, or the end of the file.
+        juce::int64 nextLineStart(juce::FileInputStream& in, juce::int64 position, juce::int64 size)
+        {
+            if (! in.setPosition(position))
+                return size;
+
+            char buffer[4096];
+            while (position < size)
+            {
+                const int n = in.read(buffer, sizeof(buffer));
+                if (n <= 0)
+                    break;
+
+                for (int i = 0; i < n; ++i)
+                    if (buffer[i] == '\n')
+                        return position + i + 1;
+
+                position += n;
+            }
+            return size;
+        }
+    }
+
+    juce::File Manifest::shardFile(size_t index) const
+    {
+        return directory.getChildFile("shard-" + juce::String(static_cast<int>(index)) + ".csv");
+    }
+
+    juce::File Manifest::receiptFile(size_t index) const
+    {
+        return directory.getChildFile("shard-" + juce::String(static_cast<int>(index)) + ".done");
+    }
+
+    std::vector<Range> splitAtLineBoundaries(const juce::File& input, int numShards)
+    {
+        std::vector<Range> ranges;
+        const auto size = input.getSize();
+        juce::FileInputStream in(input);
+        if (! in.openedOk() || size == 0)
+            return ranges;
+
+        numShards = juce::jmax(1, numShards);
+        juce::int64 begin = 0;
+
+        for (int i = 1; i < numShards && begin < size; ++i)
+        {
+            const auto target = size * i / numShards;
+            if (target <= begin)
+                continue;
+
+            const auto end = nextLineStart(in, target, size);
+            ranges.push_back({ begin, end });
+            begin = end;
+        }
+
+        if (begin < size)
+            ranges.push_back({ begin, size });
+
+        return ranges;
+    }
+
+    juce::Result plan(const juce::File& input, const juce::File& workDirectory, int numShards, Manifest& out)
+    {
+        if (! input.existsAsFile())
+            return juce::Result::fail("input not found: " + input.getFullPathName());
+
+        if (auto r = workDirectory.createDirectory(); r.failed())
+            return r;
+
+        out.input = input;
+        out.inputSize = input.getSize();
+        out.date = license::currentDate();
+        out.ranges = splitAtLineBoundaries(input, numShards);
+        out.directory = workDirectory;
+
+        if (out.ranges.empty())
+            return juce::Result::fail("input is empty");
+
+        juce::String text;
+        text << "input=" << input.getFullPathName() << '\n'
+             << "size=" << out.inputSize << '\n'
+             << "date=" << juce::String(out.date) << '\n'
+             << "shards=" << static_cast<int>(out.ranges.size()) << '\n';
+        for (size_t i = 0; i < out.ranges.size(); ++i)
+            text << "shard." << static_cast<int>(i) << '=' << out.ranges[i].begin << ' ' << out.ranges[i].end << '\n';
+
+        for (size_t i = 0; i < out.ranges.size(); ++i)
+            out.receiptFile(i).deleteFile();
+
+        if (! workDirectory.getChildFile("manifest.txt").replaceWithText(text))
+            return juce::Result::fail("failed to write manifest");
+
+        return juce::Result::ok();
+    }
+
+    juce::Result load(const juce::File& manifestFile, Manifest& out)
+    {
+        const auto values = readKeyValues(manifestFile);
+        const int count = values["shards"].getIntValue();
+        if (values["input"].isEmpty() || count <= 0)
+            return juce::Result::fail("not a shard manifest: " + manifestFile.getFullPathName());
+
+        out.input = juce::File(values["input"]);
+        out.inputSize = values["size"].getLargeIntValue();
+        out.date = values["date"].toStdString();
+        out.directory = manifestFile.getParentDirectory();
+
+        if (values["date"].length() != 8 || ! values["date"].containsOnly("0123456789"))
+            return juce::Result::fail("manifest has no issue date; plan it again: " + manifestFile.getFullPathName());
+        out.ranges.clear();
+
+        for (int i = 0; i < count; ++i)
+        {
+            const auto parts = juce::StringArray::fromTokens(values["shard." + juce::String(i)], " ", "");
+            if (parts.size() != 2)
+                return juce::Result::fail("manifest is missing shard " + juce::String(i));
+            out.ranges.push_back({ parts[0].getLargeIntValue(), parts[1].getLargeIntValue() });
+        }
+
+        return juce::Result::ok();
+    }
+
+    juce::Result runShard(const Manifest& manifest, size_t index)
+    {
+        SMK_TRACE_SCOPE("runShard");
+
+        if (index >= manifest.ranges.size())
+            return juce::Result::fail("no such shard");
+
+        if (manifest.input.getSize() != manifest.inputSize)
+            return juce::Result::fail("input changed since the manifest was written");
+
+        const auto range = manifest.ranges[index];
+        const auto outFile = manifest.shardFile(index);
+        manifest.receiptFile(index).deleteFile();
+        outFile.deleteFile();
+
+        juce::FileInputStream in(manifest.input);
+        juce::FileOutputStream out(outFile);
+        if (! in.openedOk() || ! in.setPosition(range.begin))
+            return juce::Result::fail("failed to read " + manifest.input.getFullPathName());
+        if (! out.openedOk())
+            return juce::Result::fail("failed to write " + outFile.getFullPathName());
+
+        crypto_small::detail::Sha256Context ctx;
+        crypto_small::detail::sha256Init(ctx);
+
+        juce::MemoryBlock pending;
+        juce::int64 remaining = range.end - range.begin;
+        juce::int64 rowCount = 0;
+        juce::int64 bytesWritten = 0;
+        bool atFileStart = range.begin == 0;
+
+        while (remaining > 0)
+        {
+            const auto want = static_cast<size_t>(juce::jmin(remaining, kChunkBytes));
+            const auto keep = pending.getSize();
+            pending.setSize(keep + want);
+            const int got = in.read(static_cast<char*>(pending.getData()) + keep, static_cast<int>(want));
+            if (got <= 0)
+                return juce::Result::fail("unexpected end of input");
+
+            pending.setSize(keep + static_cast<size_t>(got));
+            remaining -= got;
+
+            // Sign complete lines only; the tail waits for the next chunk.
+            const auto* data = static_cast<const char*>(pending.getData());
+            size_t cut = pending.getSize();
+            if (remaining > 0)
+                while (cut > 0 && data[cut - 1] != '\n')
+                    --cut;
+
+            const auto rows = batch::issueFromCsv(juce::String::fromUTF8(data, static_cast<int>(cut)), atFileStart,
+                                                  manifest.date);
+            atFileStart = false;
+
+            juce::MemoryOutputStream formatted;
+            batch::writeRows(formatted, rows, false);
+            crypto_small::detail::sha256Update(ctx, static_cast<const uint8_t*>(formatted.getData()), formatted.getDataSize());
+            if (! out.write(formatted.getData(), formatted.getDataSize()))
+                return juce::Result::fail("failed to write " + outFile.getFullPathName());
+
+            rowCount += static_cast<juce::int64>(rows.size());
+            bytesWritten += static_cast<juce::int64>(formatted.getDataSize());
+            pending.removeSection(0, cut);
+        }
+
+        out.flush();
+        if (out.getStatus().failed())
+            return out.getStatus();
+
+        juce::String receipt;
+        receipt << "rows=" << rowCount << '\n'
+                << "bytes=" << bytesWritten << '\n'
+                << "date=" << juce::String(manifest.date) << '\n'
+                << "sha256=" << finalHex(ctx) << '\n';
+
+        if (! manifest.receiptFile(index).replaceWithText(receipt))
+            return juce::Result::fail("failed to write receipt");
+
+        return juce::Result::ok();
+    }
+
+    juce::Result merge(const Manifest& manifest, const juce::File& output)
+    {
+        SMK_TRACE_SCOPE("mergeShards");
+
+        const auto partial = output.getSiblingFile(output.getFileName() + ".partial");
+        partial.deleteFile();
+
+        {
+            juce::FileOutputStream out(partial);
+            if (! out.openedOk())
+                return juce::Result::fail("failed to write " + partial.getFullPathName());
+
+            batch::writeRows(out, {}, true);
+
+            std::vector<char> buffer(1 << 20);
+            for (size_t i = 0; i < manifest.ranges.size(); ++i)
+            {
+                const auto receipt = readKeyValues(manifest.receiptFile(i));
+                const auto shardFile = manifest.shardFile(i);
+                const auto shardName = shardFile.getFileName();
+
+                if (receipt["sha256"].isEmpty())
+                    return juce::Result::fail(shardName + " has not finished");
+                if (receipt["date"] != juce::String(manifest.date))
+                    return juce::Result::fail(shardName + " was signed for " + receipt["date"]
+                                              + ", not the planned " + juce::String(manifest.date));
+                if (shardFile.getSize() != receipt["bytes"].getLargeIntValue())
+                    return juce::Result::fail(shardName + " size does not match its receipt");
+
+                juce::FileInputStream in(shardFile);
+                if (! in.openedOk())
+                    return juce::Result::fail("failed to read " + shardName);
+
+                crypto_small::detail::Sha256Context ctx;
+                crypto_small::detail::sha256Init(ctx);
+
+                for (;;)
+                {
+                    const int n = in.read(buffer.data(), static_cast<int>(buffer.size()));
+                    if (n <= 0)
+                        break;
+                    crypto_small::detail::sha256Update(ctx, reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(n));
+                    out.write(buffer.data(), static_cast<size_t>(n));
+                }
+
+                if (finalHex(ctx) != receipt["sha256"])
+                    return juce::Result::fail(shardName + " checksum mismatch");
+            }
+
+            out.flush();
+            if (out.getStatus().failed())
+                return out.getStatus();
+        }
+
+        if (! partial.moveFileTo(output))
+            return juce::Result::fail("failed to move " + partial.getFullPathName());
+
+        return juce::Result::ok();
+    }
+
+    bool handles(const juce::StringArray& args)
+    {
+        return args.contains("--shard") || args.contains("--shard-plan")
+            || args.contains("--shard-run") || args.contains("--shard-merge");
+    }
+
+    commands::Result run(const juce::StringArray& args, const juce::File& cwd)
+    {
+        auto toResult = [](const juce::Result& r, const juce::String& okMessage) -> commands::Result
+        {
+            return r.wasOk() ? commands::Result { 0, okMessage } : commands::Result { 1, r.getErrorMessage() };
+        };
+
+        if (const int i = args.indexOf("--shard-plan"); i >= 0)
+        {
+            if (args.size() < i + 4)
+                return { 1, "usage: --shard-plan <in.csv> <work-dir> <n>" };
+
+            Manifest manifest;
+            const auto r = plan(cwd.getChildFile(args[i + 1]), cwd.getChildFile(args[i + 2]), args[i + 3].getIntValue(), manifest);
+            return toResult(r, juce::String(static_cast<int>(manifest.ranges.size())) + " shards planned.");
+        }
+
+        if (const int i = args.indexOf("--shard-run"); i >= 0)
+        {
+            if (args.size() < i + 3)
+                return { 1, "usage: --shard-run <manifest> <index>" };
+
+            Manifest manifest;
+            auto r = load(cwd.getChildFile(args[i + 1]), manifest);
+            if (r.wasOk())
+                r = runShard(manifest, static_cast<size_t>(args[i + 2].getIntValue()));
+            return toResult(r, "Shard " + args[i + 2] + " done.");
+        }
+
+        if (const int i = args.indexOf("--shard-merge"); i >= 0)
+        {
+            if (args.size() < i + 3)
+                return { 1, "usage: --shard-merge <manifest> <out.csv>" };
+
+            Manifest manifest;
+            auto r = load(cwd.getChildFile(args[i + 1]), manifest);
+            if (r.wasOk())
+                r = merge(manifest, cwd.getChildFile(args[i + 2]));
+            return toResult(r, "Shards merged.");
+        }
+
+        const int i = args.indexOf("--shard");
+        if (i < 0 || args.size() < i + 4)
+            return { 1, "usage: --shard <in.csv> <out.csv> <n>" };
+
+        const auto output = cwd.getChildFile(args[i + 2]);
+        Manifest manifest;
+        if (auto r = plan(cwd.getChildFile(args[i + 1]), output.getSiblingFile(output.getFileName() + ".shards"),
+                          args[i + 3].getIntValue(), manifest); r.failed())
+            return toResult(r, {});
+
+        // One worker process per shard; --local keeps them from being
+        // forwarded back into a resident instance.
+        const auto exe = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getFullPathName();
+        const auto manifestPath = manifest.directory.getChildFile("manifest.txt").getFullPathName();
+        juce::OwnedArray<juce::ChildProcess> workers;
+
+        // ChildProcess leaves its process running when deleted, so on any
+        // failure the rest are stopped before they write more shard files.
+        auto stopWorkers = [&workers]
+        {
+            for (auto* child : workers)
+            {
+                if (child->isRunning())
+                    child->kill();
+                child->waitForProcessToFinish(5000);
+            }
+        };
+
+        for (size_t s = 0; s < manifest.ranges.size(); ++s)
+        {
+            auto* child = workers.add(new juce::ChildProcess());
+            if (! child->start(juce::StringArray { exe, "--local", "--shard-run", manifestPath, juce::String(static_cast<int>(s)) }, 0))
+            {
+                stopWorkers();
+                return { 1, "failed to start worker " + juce::String(static_cast<int>(s)) };
+            }
+        }
+
+        for (int s = 0; s < workers.size(); ++s)
+        {
+            while (workers[s]->isRunning())
+                workers[s]->waitForProcessToFinish(1000);
+
+            if (workers[s]->getExitCode() != 0)
+            {
+                stopWorkers();
+                return { 1, "worker " + juce::String(s) + " failed" };
+            }
+        }
+
+        return toResult(merge(manifest, output), juce::String(workers.size()) + " shards merged into " + output.getFullPathName());
+    }
+} // namespace shard
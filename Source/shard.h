@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "commands.h"
+#include <string>
+#include <vector>
+
+/*
+    Multi-process sharded batch issuance.
+
+    plan() splits an input CSV at line boundaries into N contiguous byte
+    ranges and records them in a manifest. Each shard is then signed by an
+    independent process (--shard-run), locally or on another host sharing the
+    filesystem, which writes shard-<i>.csv plus a shard-<i>.done receipt with
+    its row count, size and SHA-256. The plan fixes the issue date, so every
+    shard signs with the same date wherever and whenever it runs; receipts
+    repeat it and merge() rejects a shard signed for any other. merge()
+    validates every receipt and concatenates the shards in index order,
+    which is the original row order.
+
+        --shard       <in.csv> <out.csv> <n>   plan, fork n local workers, merge
+        --shard-plan  <in.csv> <work-dir> <n>
+        --shard-run   <manifest> <index>
+        --shard-merge <manifest> <out.csv>
+*/
+namespace shard
+{
+    struct Range
+    {
+        juce::int64 begin = 0;
+        juce::int64 end = 0;
+    };
+
+    struct Manifest
+    {
+        juce::File input;
+        juce::int64 inputSize = 0;
+        std::string date;           // YYYYMMDD every shard signs with
+        std::vector<Range> ranges;
+
+        juce::File directory;
+
+        juce::File shardFile(size_t index) const;
+        juce::File receiptFile(size_t index) const;
+    };
+
+    // Splits input into at most numShards ranges, each ending just after a newline.
+    std::vector<Range> splitAtLineBoundaries(const juce::File& input, int numShards);
+
+    juce::Result plan(const juce::File& input, const juce::File& workDirectory, int numShards, Manifest& out);
+    juce::Result load(const juce::File& manifestFile, Manifest& out);
+
+    juce::Result runShard(const Manifest& manifest, size_t index);
+    juce::Result merge(const Manifest& manifest, const juce::File& output);
+
+    bool handles(const juce::StringArray& args);
+    commands::Result run(const juce::StringArray& args, const juce::File& workingDirectory);
+} // namespace shard
@@ -0,0 +1,511 @@
+#include "sinks.h"
+#include "trace.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+ #define SMK_SINKS_POSIX 0
+#else
+ #define SMK_SINKS_POSIX 1
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/uio.h>
+ #include <unistd.h>
+#endif
+
+namespace sinks
+{
+    namespace
+    {
+        constexpr size_t kBlockBytes = 1 << 20;
+        constexpr size_t kBlockCount = 8;
+
+        struct Field
+        {
+            const char* data;
+            size_t size;
+        };
+
+        using Fields = std::array<Field, 4>;
+
+        Fields fieldsOf(const batch::Row& row)
+        {
+            auto utf8 = [](const juce::String& s) { return Field { s.toRawUTF8(), s.getNumBytesAsUTF8() }; };
+            return { utf8(row.first), utf8(row.last), utf8(row.email), utf8(row.license) };
+        }
+
+        char* put(char* dst, const char* src, size_t len)
+        {
+            std::memcpy(dst, src, len);
+            return dst + len;
+        }
+
+        //==============================================================================
+        struct CsvFormatter
+        {
+            static constexpr const char* header = "first,last,email,license\n";
+
+            static bool fits(const Fields&) { return true; }
+
+            static size_t bound(const Fields& f)
+            {
+                size_t n = 5;
+                for (const auto& field : f)
+                    n += field.size * 2 + 2;
+                return n;
+            }
+
+            static char* putField(char* d, Field f)
+            {
+                bool needsQuotes = false;
+                for (size_t i = 0; i < f.size && ! needsQuotes; ++i)
+                    needsQuotes = f.data[i] == ',' || f.data[i] == '"' || f.data[i] == '\n' || f.data[i] == '\r';
+
+                if (! needsQuotes)
+                    return put(d, f.data, f.size);
+
+                *d++ = '"';
+                for (size_t i = 0; i < f.size; ++i)
+                {
+                    if (f.data[i] == '"')
+                        *d++ = '"';
+                    *d++ = f.data[i];
+                }
+                *d++ = '"';
+                return d;
+            }
+
+            static char* format(char* d, const Fields& f)
+            {
+                for (size_t i = 0; i < f.size(); ++i)
+                {
+                    if (i != 0)
+                        *d++ = ',';
+                    d = putField(d, f[i]);
+                }
+                *d++ = '\n';
+                return d;
+            }
+        };
+
+        struct JsonLinesFormatter
+        {
+            static constexpr const char* header = "";
+
+            static bool fits(const Fields&) { return true; }
+
+            static size_t bound(const Fields& f)
+            {
+                size_t n = 64;
+                for (const auto& field : f)
+                    n += field.size * 6;
+                return n;
+            }
+
+            static char* putString(char* d, Field f)
+            {
+                static constexpr char hex[] = "0123456789abcdef";
+                *d++ = '"';
+                for (size_t i = 0; i < f.size; ++i)
+                {
+                    const auto c = static_cast<unsigned char>(f.data[i]);
+                    if (c == '"' || c == '\\')
+                    {
+                        *d++ = '\\';
+                        *d++ = static_cast<char>(c);
+                    }
+                    else if (c < 0x20)
+                    {
+                        d = put(d, "\\u00", 4);
+                        *d++ = hex[c >> 4];
+                        *d++ = hex[c & 0xf];
+                    }
+                    else
+                    {
+                        *d++ = static_cast<char>(c);
+                    }
+                }
+                *d++ = '"';
+                return d;
+            }
+
+            static char* format(char* d, const Fields& f)
+            {
+                d = put(d, "{\"first\":", 9);
+                d = putString(d, f[0]);
+                d = put(d, ",\"last\":", 8);
+                d = putString(d, f[1]);
+                d = put(d, ",\"email\":", 9);
+                d = putString(d, f[2]);
+                d = put(d, ",\"license\":", 11);
+                d = putString(d, f[3]);
+                d = put(d, "}\n", 2);
+                return d;
+            }
+        };
+
+        struct FixedWidthFormatter
+        {
+            static constexpr const char* header = "";
+
+            static bool fits(const Fields& f)
+            {
+                return f[0].size <= kFirstWidth && f[1].size <= kLastWidth
+                    && f[2].size <= kEmailWidth && f[3].size <= kLicenseSlot;
+            }
+
+            static size_t bound(const Fields&) { return kFixedRecordBytes; }
+
+            // Pads with spaces; fits() has already ruled out anything wider.
+            // Control characters become spaces so a record stays one line.
+            static char* putPadded(char* d, Field f, size_t width)
+            {
+                for (size_t i = 0; i < f.size; ++i)
+                    d[i] = static_cast<unsigned char>(f.data[i]) < 0x20 ? ' ' : f.data[i];
+                d += f.size;
+                std::memset(d, ' ', width - f.size);
+                return d + (width - f.size);
+            }
+
+            static char* format(char* d, const Fields& f)
+            {
+                d = putPadded(d, f[0], kFirstWidth);
+                d = putPadded(d, f[1], kLastWidth);
+                d = putPadded(d, f[2], kEmailWidth);
+                d = putPadded(d, f[3], kLicenseSlot);
+                *d++ = '\n';
+                return d;
+            }
+        };
+
+        //==============================================================================
+        class Backend
+        {
+        public:
+            virtual ~Backend() = default;
+            virtual bool isOk() const = 0;
+            virtual char* reserve(size_t bytes) = 0;
+            virtual void commit(size_t bytes) = 0;
+            virtual bool finish() = 0;
+        };
+
+        // Fills a ring of fixed blocks and hands all of them to the OS in one go.
+        class BlockBackend : public Backend
+        {
+        public:
+            explicit BlockBackend(const juce::File& file)
+            {
+               #if SMK_SINKS_POSIX
+                fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                ok = fd >= 0;
+               #else
+                stream = std::make_unique<juce::FileOutputStream>(file, 0);
+                ok = stream->openedOk() && stream->setPosition(0) && stream->truncate().wasOk();
+               #endif
+
+                blocks.resize(kBlockCount);
+                for (auto& b : blocks)
+                    b.resize(kBlockBytes);
+                used.assign(kBlockCount, 0);
+            }
+
+            ~BlockBackend() override
+            {
+                finish();
+            }
+
+            bool isOk() const override { return ok; }
+
+            char* reserve(size_t bytes) override
+            {
+                if (used[current] + bytes > blocks[current].size())
+                {
+                    if (current + 1 == blocks.size())
+                        flush();
+                    else
+                        ++current;
+
+                    // A single oversized record gets a block of its own size.
+                    if (blocks[current].size() < bytes)
+                        blocks[current].resize(bytes);
+                }
+                return blocks[current].data() + used[current];
+            }
+
+            void commit(size_t bytes) override { used[current] += bytes; }
+
+            bool finish() override
+            {
+                if (finished)
+                    return ok;
+
+                flush();
+                finished = true;
+
+               #if SMK_SINKS_POSIX
+                if (fd >= 0 && ::close(fd) != 0)
+                    ok = false;
+                fd = -1;
+               #else
+                stream->flush();
+                ok = ok && stream->getStatus().wasOk();
+                stream = nullptr;
+               #endif
+                return ok;
+            }
+
+        private:
+            void flush()
+            {
+                SMK_TRACE_SCOPE("sinkFlush");
+
+               #if SMK_SINKS_POSIX
+                iovec iov[kBlockCount];
+                int count = 0;
+                for (size_t i = 0; i <= current; ++i)
+                    if (used[i] > 0)
+                        iov[count++] = { blocks[i].data(), used[i] };
+
+                int first = 0;
+                while (ok && first < count)
+                {
+                    const auto n = ::writev(fd, iov + first, count - first);
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        ok = false;
+                        break;
+                    }
+
+                    // Skip fully written buffers and trim a partially written one.
+                    auto remaining = static_cast<size_t>(n);
+                    while (first < count && remaining >= iov[first].iov_len)
+                        remaining -= iov[first++].iov_len;
+                    if (first < count)
+                    {
+                        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+                        iov[first].iov_len -= remaining;
+                    }
+                }
+               #else
+                for (size_t i = 0; i <= current && ok; ++i)
+                    if (used[i] > 0)
+                        ok = stream->write(blocks[i].data(), used[i]);
+               #endif
+
+                std::fill(used.begin(), used.end(), size_t(0));
+                current = 0;
+            }
+
+            std::vector<std::vector<char>> blocks;
+            std::vector<size_t> used;
+            size_t current = 0;
+            bool ok = false;
+            bool finished = false;
+
+           #if SMK_SINKS_POSIX
+            int fd = -1;
+           #else
+            std::unique_ptr<juce::FileOutputStream> stream;
+           #endif
+        };
+
+       #if SMK_SINKS_POSIX
+        // Sizes the file once and formats records directly into the mapping.
+        class MappedBackend : public Backend
+        {
+        public:
+            MappedBackend(const juce::File& file, size_t expectedBytes)
+            {
+                fd = ::open(file.getFullPathName().toRawUTF8(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                ok = fd >= 0 && map(juce::jmax(expectedBytes, size_t(4096)));
+            }
+
+            ~MappedBackend() override
+            {
+                finish();
+            }
+
+            bool isOk() const override { return ok; }
+
+            char* reserve(size_t bytes) override
+            {
+                // More rows than promised: grow the file rather than fail.
+                if (used + bytes > capacity && ! map(juce::jmax(capacity * 2, used + bytes)))
+                    return scratch(bytes);
+                return base + used;
+            }
+
+            void commit(size_t bytes) override
+            {
+                if (ok)
+                    used += bytes;
+            }
+
+            bool finish() override
+            {
+                if (fd < 0)
+                    return ok;
+
+                if (base != nullptr)
+                    ::munmap(base, capacity);
+                base = nullptr;
+
+                if (::ftruncate(fd, static_cast<off_t>(used)) != 0)
+                    ok = false;
+                if (::close(fd) != 0)
+                    ok = false;
+                fd = -1;
+                return ok;
+            }
+
+        private:
+            bool map(size_t newCapacity)
+            {
+                if (base != nullptr)
+                    ::munmap(base, capacity);
+                base = nullptr;
+
+                if (::ftruncate(fd, static_cast<off_t>(newCapacity)) != 0)
+                    return ok = false;
+
+                void* p = ::mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED)
+                    return ok = false;
+
+                base = static_cast<char*>(p);
+                capacity = newCapacity;
+                return true;
+            }
+
+            // Somewhere harmless to format into once the sink has failed.
+            char* scratch(size_t bytes)
+            {
+                ok = false;
+                overflow.resize(juce::jmax(overflow.size(), bytes));
+                return overflow.data();
+            }
+
+            int fd = -1;
+            char* base = nullptr;
+            size_t capacity = 0;
+            size_t used = 0;
+            bool ok = false;
+            std::vector<char> overflow;
+        };
+       #endif
+
+        //==============================================================================
+        template <typename Formatter>
+        class FormattedSink : public Sink
+        {
+        public:
+            explicit FormattedSink(std::unique_ptr<Backend> b) : backend(std::move(b))
+            {
+                const size_t len = std::strlen(Formatter::header);
+                if (len > 0)
+                {
+                    std::memcpy(backend->reserve(len), Formatter::header, len);
+                    backend->commit(len);
+                }
+            }
+
+            bool write(const batch::Row& row) override
+            {
+                const auto fields = fieldsOf(row);
+                if (! Formatter::fits(fields))
+                {
+                    ++rejected;
+                    return false;
+                }
+
+                char* start = backend->reserve(Formatter::bound(fields));
+                char* end = Formatter::format(start, fields);
+                backend->commit(static_cast<size_t>(end - start));
+                return backend->isOk();
+            }
+
+            juce::int64 rejectedRows() const override { return rejected; }
+
+            bool close() override
+            {
+                return backend->finish();
+            }
+
+        private:
+            std::unique_ptr<Backend> backend;
+            juce::int64 rejected = 0;
+        };
+    }
+
+    Format formatFor(const juce::File& file)
+    {
+        if (file.hasFileExtension("jsonl;ndjson"))
+            return Format::jsonLines;
+        if (file.hasFileExtension("txt;fixed"))
+            return Format::fixedWidth;
+        return Format::csv;
+    }
+
+    juce::String formatName(Format format)
+    {
+        switch (format)
+        {
+            case Format::jsonLines:  return "JSON Lines";
+            case Format::fixedWidth: return "fixed-width";
+            case Format::csv:        break;
+        }
+        return "CSV";
+    }
+
+    std::unique_ptr<Sink> open(const juce::File& file, Format format, juce::int64 expectedRows)
+    {
+        std::unique_ptr<Backend> backend;
+
+       #if SMK_SINKS_POSIX
+        if (format == Format::fixedWidth && expectedRows >= 0)
+            backend = std::make_unique<MappedBackend>(file, static_cast<size_t>(expectedRows) * kFixedRecordBytes);
+       #endif
+
+        if (backend == nullptr)
+            backend = std::make_unique<BlockBackend>(file);
+
+        if (! backend->isOk())
+            return nullptr;
+
+        switch (format)
+        {
+            case Format::jsonLines:  return std::make_unique<FormattedSink<JsonLinesFormatter>>(std::move(backend));
+            case Format::fixedWidth: return std::make_unique<FormattedSink<FixedWidthFormatter>>(std::move(backend));
+            case Format::csv:        break;
+        }
+        return std::make_unique<FormattedSink<CsvFormatter>>(std::move(backend));
+    }
+
+    juce::Result writeAll(const juce::File& file, const std::vector<batch::Row>& rows)
+    {
+        SMK_TRACE_SCOPE("writeAll");
+
+        const auto format = formatFor(file);
+        auto sink = open(file, format, static_cast<juce::int64>(rows.size()));
+        if (sink == nullptr)
+            return juce::Result::fail("failed to write " + file.getFullPathName());
+
+        bool ok = true;
+        for (const auto& row : rows)
+            ok = sink->write(row) && ok;
+
+        const bool closed = sink->close();
+        if (const auto rejected = sink->rejectedRows(); rejected > 0)
+            return juce::Result::fail(juce::String(rejected) + " rows have a field too wide for " + formatName(format)
+                                      + " output; nothing was truncated, those rows were left out of " + file.getFileName());
+
+        if (! closed || ! ok)
+            return juce::Result::fail("failed to write " + file.getFullPathName());
+
+        return juce::Result::ok();
+    }
+} // namespace sinks
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "batch.h"
+#include <memory>
+#include <vector>
+
+/*
+    Output sinks for issued licenses.
+
+    Records are formatted straight into large preallocated blocks rather
+    than streamed field by field. Full blocks go to disk together with one
+    writev() on POSIX (one write per block elsewhere). When the final size
+    is known up front, as for fixed-width output with a known row count, the
+    file is sized once and formatted in place through a memory map.
+
+        csv         first,last,email,license with RFC 4180 quoting
+        jsonl       one {"first":..,"last":..,"email":..,"license":..} per line
+        fixed-width first(32) last(32) email(254) license(27) + '\n', space padded
+
+    Fixed-width columns never truncate: a row with a name longer than its
+    column (in UTF-8 bytes) is refused, counted in rejectedRows() and makes
+    write() return false. The email column holds anything RFC 5321 allows.
+*/
+namespace sinks
+{
+    enum class Format
+    {
+        csv,
+        jsonLines,
+        fixedWidth
+    };
+
+    constexpr size_t kFirstWidth = 32;
+    constexpr size_t kLastWidth = 32;
+    constexpr size_t kEmailWidth = 254;
+    constexpr size_t kLicenseSlot = 27;
+    constexpr size_t kFixedRecordBytes = kFirstWidth + kLastWidth + kEmailWidth + kLicenseSlot + 1;
+
+    // .jsonl / .ndjson -> JSON Lines, .txt / .fixed -> fixed-width, anything else CSV.
+    Format formatFor(const juce::File& file);
+
+    // "CSV", "JSON Lines" or "fixed-width", for messages.
+    juce::String formatName(Format format);
+
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        // False if the row was refused or the write failed.
+        virtual bool write(const batch::Row& row) = 0;
+
+        // Rows refused because a field doesn't fit the format.
+        virtual juce::int64 rejectedRows() const = 0;
+
+        // Flushes everything and closes the file; returns false if any write failed.
+        virtual bool close() = 0;
+    };
+
+    // expectedRows lets fixed-width output map the whole file up front;
+    // pass -1 when the count isn't known.
+    std::unique_ptr<Sink> open(const juce::File& file, Format format, juce::int64 expectedRows = -1);
+
+    // Writes rows to file in the format its extension implies, replacing it.
+    // Fails if any row was refused or the file couldn't be written.
+    juce::Result writeAll(const juce::File& file, const std::vector<batch::Row>& rows);
+} // namespace sinks
@@ -0,0 +1,189 @@
+#include "smkeygen.h"
+#include "license.h"
+#include "packed_license.h"
+#include "verify_cache.h"
+
+#include <cstring>
+#include <new>
+#include <string>
+
+struct smk_context
+{
+    explicit smk_context(const license::SigningKey& k) : key(k) {}
+
+    license::SigningKey key;
+    mutable license::VerificationCache cache; // internally locked
+};
+
+namespace
+{
+    bool isValid(const smk_field& field) noexcept
+    {
+        return field.data != nullptr || field.size == 0;
+    }
+
+    std::string toString(const smk_field& field)
+    {
+        return field.size == 0 ? std::string() : std::string(field.data, field.size);
+    }
+
+    // Null or empty means today; anything else must be a real YYYYMMDD date.
+    bool resolveDate(const char* yyyymmdd, std::string& out)
+    {
+        if (yyyymmdd == nullptr || *yyyymmdd == '\0')
+        {
+            out = license::currentDate();
+            return true;
+        }
+
+        out.assign(yyyymmdd, ::strnlen(yyyymmdd, 9));
+        uint32_t days = 0;
+        return license::daysFromYYYYMMDD(out, days);
+    }
+
+    template <typename Fn>
+    smk_status guarded(Fn&& fn) noexcept
+    {
+        try
+        {
+            return fn();
+        }
+        catch (const std::bad_alloc&)
+        {
+            return SMK_OUT_OF_MEMORY;
+        }
+        catch (...)
+        {
+            return SMK_INTERNAL_ERROR;
+        }
+    }
+
+    smk_status issueRow(const smk_context& context, const smk_field& first, const smk_field& last,
+                        const smk_field& email, const std::string& date, char* out)
+    {
+        if (! isValid(first) || ! isValid(last) || ! isValid(email))
+            return SMK_INVALID_ARGUMENT;
+
+        const auto key = context.key.makeLicense(toString(first), toString(last), toString(email), date);
+        if (key.size() != SMK_LICENSE_LENGTH)
+            return SMK_INTERNAL_ERROR;
+
+        std::memcpy(out, key.data(), SMK_LICENSE_LENGTH);
+        return SMK_OK;
+    }
+
+    smk_status verifyRow(const smk_context& context, const smk_field& key, const smk_field& first,
+                         const smk_field& last, const smk_field& email, bool& valid)
+    {
+        if (! isValid(key) || ! isValid(first) || ! isValid(last) || ! isValid(email))
+            return SMK_INVALID_ARGUMENT;
+
+        valid = context.cache.verify(context.key, toString(key), toString(first), toString(last), toString(email));
+        return SMK_OK;
+    }
+}
+
+extern "C"
+{
+    uint32_t smk_abi_version(void)
+    {
+        return SMK_ABI_VERSION;
+    }
+
+    smk_status smk_context_new(const uint8_t* secret, size_t secret_size, smk_context** out)
+    {
+        if (out == nullptr || (secret == nullptr && secret_size != 0))
+            return SMK_INVALID_ARGUMENT;
+
+        *out = nullptr;
+        return guarded([&]
+        {
+            *out = secret == nullptr ? new smk_context(license::SigningKey::builtIn())
+                                     : new smk_context(license::SigningKey(secret, secret_size));
+            return SMK_OK;
+        });
+    }
+
+    void smk_context_free(smk_context* context)
+    {
+        delete context;
+    }
+
+    smk_status smk_issue(const smk_context* context, smk_field first, smk_field last, smk_field email,
+                         const char* yyyymmdd, char out_license[SMK_LICENSE_LENGTH])
+    {
+        if (context == nullptr || out_license == nullptr)
+            return SMK_INVALID_ARGUMENT;
+
+        return guarded([&]
+        {
+            std::string date;
+            if (! resolveDate(yyyymmdd, date))
+                return SMK_INVALID_ARGUMENT;
+            return issueRow(*context, first, last, email, date, out_license);
+        });
+    }
+
+    smk_status smk_verify(const smk_context* context, smk_field license, smk_field first, smk_field last,
+                          smk_field email, int* out_valid)
+    {
+        if (context == nullptr || out_valid == nullptr)
+            return SMK_INVALID_ARGUMENT;
+
+        return guarded([&]
+        {
+            bool valid = false;
+            const auto status = verifyRow(*context, license, first, last, email, valid);
+            *out_valid = valid ? 1 : 0;
+            return status;
+        });
+    }
+
+    smk_status smk_issue_batch(const smk_context* context, size_t count, const smk_field* first,
+                               const smk_field* last, const smk_field* email, const char* yyyymmdd,
+                               char* out_licenses)
+    {
+        if (count == 0)
+            return SMK_OK;
+        if (context == nullptr || first == nullptr || last == nullptr || email == nullptr || out_licenses == nullptr)
+            return SMK_INVALID_ARGUMENT;
+
+        return guarded([&]
+        {
+            // Resolved once, so a batch straddling midnight gets one date.
+            std::string date;
+            if (! resolveDate(yyyymmdd, date))
+                return SMK_INVALID_ARGUMENT;
+
+            for (size_t i = 0; i < count; ++i)
+                if (const auto status = issueRow(*context, first[i], last[i], email[i], date,
+                                                 out_licenses + i * SMK_LICENSE_LENGTH); status != SMK_OK)
+                    return status;
+
+            return SMK_OK;
+        });
+    }
+
+    smk_status smk_verify_batch(const smk_context* context, size_t count, const smk_field* licenses,
+                                const smk_field* first, const smk_field* last, const smk_field* email,
+                                uint8_t* out_valid)
+    {
+        if (count == 0)
+            return SMK_OK;
+        if (context == nullptr || licenses == nullptr || first == nullptr || last == nullptr
+            || email == nullptr || out_valid == nullptr)
+            return SMK_INVALID_ARGUMENT;
+
+        return guarded([&]
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                bool valid = false;
+                if (const auto status = verifyRow(*context, licenses[i], first[i], last[i], email[i], valid); status != SMK_OK)
+                    return status;
+                out_valid[i] = valid ? 1 : 0;
+            }
+            return SMK_OK;
+        });
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+    C ABI for embedding license issue and verification in other services,
+    built as libsmkeygen from license.cpp, packed_license.cpp, metrics.cpp,
+    trace.cpp, verify_cache.cpp and smkeygen.cpp (no JUCE) by
+    Builds/libsmkeygen/CMakeLists.txt, or by hand:
+
+        c++ -std=c++20 -O2 -shared -fPIC -fvisibility=hidden -DSMK_BUILDING_LIBRARY \
+            license.cpp packed_license.cpp metrics.cpp trace.cpp verify_cache.cpp smkeygen.cpp -o libsmkeygen.so
+
+    Strings are passed as pointer + length and need not be NUL-terminated.
+    Keys are written into caller-owned buffers of SMK_LICENSE_LENGTH bytes,
+    also without a terminator. A context is immutable once created, so one
+    can be shared by any number of threads. No C++ exception crosses this
+    boundary; every entry point returns an smk_status.
+
+    The ABI is versioned: smk_abi_version() returns SMK_ABI_VERSION of the
+    library actually loaded. Additions bump the minor part, anything that
+    breaks existing callers bumps the major part.
+
+    Keys are issued in the V1 scheme (license::kIssueScheme), so smk_issue
+    output is what ABI 1.0 produced. Since 1.1 smk_verify and
+    smk_verify_batch also accept V2 keys.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+ #if defined(SMK_BUILDING_LIBRARY)
+  #define SMK_API __declspec(dllexport)
+ #else
+  #define SMK_API __declspec(dllimport)
+ #endif
+#else
+ #define SMK_API __attribute__((visibility("default")))
+#endif
+
+#define SMK_ABI_VERSION_MAJOR 1
+#define SMK_ABI_VERSION_MINOR 1
+#define SMK_ABI_VERSION ((SMK_ABI_VERSION_MAJOR << 16) | SMK_ABI_VERSION_MINOR)
+
+#define SMK_LICENSE_LENGTH 26
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum smk_status
+{
+    SMK_OK = 0,
+    SMK_INVALID_ARGUMENT = 1,   /* null pointer, bad date, ... */
+    SMK_OUT_OF_MEMORY = 2,
+    SMK_INTERNAL_ERROR = 3
+} smk_status;
+
+typedef struct smk_field
+{
+    const char* data;   /* UTF-8, may be null when size is 0 */
+    size_t size;
+} smk_field;
+
+typedef struct smk_context smk_context;
+
+SMK_API uint32_t smk_abi_version(void);
+
+/* Keys a context with secret, or with the built-in secret when secret is
+   null. The HMAC key schedule is done here, once. */
+SMK_API smk_status smk_context_new(const uint8_t* secret, size_t secret_size, smk_context** out);
+SMK_API void smk_context_free(smk_context* context);
+
+/* yyyymmdd: 8 digits, or null or "" for today (UTC). */
+SMK_API smk_status smk_issue(const smk_context* context,
+                             smk_field first, smk_field last, smk_field email,
+                             const char* yyyymmdd,
+                             char out_license[SMK_LICENSE_LENGTH]);
+
+/* *out_valid is set to 1 or 0. */
+SMK_API smk_status smk_verify(const smk_context* context,
+                              smk_field license,
+                              smk_field first, smk_field last, smk_field email,
+                              int* out_valid);
+
+/* count rows from parallel arrays; row i's key goes to
+   out_licenses + i * SMK_LICENSE_LENGTH. */
+SMK_API smk_status smk_issue_batch(const smk_context* context, size_t count,
+                                   const smk_field* first, const smk_field* last, const smk_field* email,
+                                   const char* yyyymmdd,
+                                   char* out_licenses);
+
+/* out_valid[i] is set to 1 or 0 for each row. */
+SMK_API smk_status smk_verify_batch(const smk_context* context, size_t count,
+                                    const smk_field* licenses,
+                                    const smk_field* first, const smk_field* last, const smk_field* email,
+                                    uint8_t* out_valid);
+
+#ifdef __cplusplus
+}
+#endif
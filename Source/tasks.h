@@ -0,0 +1,136 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "workers.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+/*
+    Background work with message-thread continuations.
+
+    run() queues work with the shared workers (interactive unless bulk is
+    asked for) or on a SerialQueue, and calls then(result) back on the
+    message thread. The continuation is skipped if the owning component
+    has been deleted by then, so it may capture `this`; the work itself must
+    not touch the component.
+*/
+namespace tasks
+{
+    namespace detail
+    {
+        template <typename Work, typename Then>
+        auto makeJob(juce::Component& owner, Work work, Then then)
+        {
+            using Result = std::invoke_result_t<Work&>;
+            juce::Component::SafePointer<juce::Component> safeOwner(&owner);
+
+            return [safeOwner, work = std::move(work), then = std::move(then)]() mutable
+            {
+                if constexpr (std::is_void_v<Result>)
+                {
+                    work();
+                    juce::MessageManager::callAsync([safeOwner, then = std::move(then)]() mutable
+                    {
+                        if (safeOwner != nullptr)
+                            then();
+                    });
+                }
+                else
+                {
+                    // shared_ptr keeps the callAsync lambda copyable for move-only results.
+                    auto result = std::make_shared<Result>(work());
+                    juce::MessageManager::callAsync([safeOwner, then = std::move(then), result]() mutable
+                    {
+                        if (safeOwner != nullptr)
+                            then(std::move(*result));
+                    });
+                }
+            };
+        }
+    } // namespace detail
+
+    // Runs jobs one at a time, in the order they were added, on the shared
+    // workers. Jobs keep the queue's state alive, so the queue itself may be
+    // destroyed while they run.
+    class SerialQueue
+    {
+    public:
+        explicit SerialQueue(workers::Priority priorityToUse = workers::Priority::interactive)
+            : priority(priorityToUse)
+        {
+        }
+
+        void add(std::function<void()> job)
+        {
+            {
+                std::lock_guard<std::mutex> hold(state->lock);
+                state->jobs.push_back(std::move(job));
+                if (state->draining)
+                    return;
+                state->draining = true;
+            }
+
+            workers::submit(priority, [s = state] { drain(*s); });
+        }
+
+        // Waits up to timeoutMs for every job added so far to finish; true if they did.
+        bool waitUntilIdle(int timeoutMs)
+        {
+            std::unique_lock<std::mutex> hold(state->lock);
+            return state->idle.wait_for(hold, std::chrono::milliseconds(timeoutMs), [this] { return ! state->draining; });
+        }
+
+    private:
+        struct State
+        {
+            std::mutex lock;
+            std::condition_variable idle;
+            std::deque<std::function<void()>> jobs;
+            bool draining = false; // a drain job is queued or running
+        };
+
+        static void drain(State& s)
+        {
+            for (;;)
+            {
+                std::function<void()> job;
+                {
+                    std::lock_guard<std::mutex> hold(s.lock);
+                    if (s.jobs.empty())
+                    {
+                        s.draining = false;
+                        s.idle.notify_all();
+                        return;
+                    }
+                    job = std::move(s.jobs.front());
+                    s.jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::shared_ptr<State> state = std::make_shared<State>();
+        const workers::Priority priority;
+
+        JUCE_DECLARE_NON_COPYABLE (SerialQueue)
+    };
+
+    template <typename Work, typename Then>
+    void run(juce::Component& owner, Work work, Then then,
+             workers::Priority priority = workers::Priority::interactive)
+    {
+        workers::submit(priority, detail::makeJob(owner, std::move(work), std::move(then)));
+    }
+
+    template <typename Work, typename Then>
+    void run(juce::Component& owner, Work work, Then then, SerialQueue& queue)
+    {
+        queue.add(detail::makeJob(owner, std::move(work), std::move(then)));
+    }
+} // namespace tasks
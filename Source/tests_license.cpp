@@ -1,7 +1,14 @@
 #if defined(RUN_LICENSE_TESTS)
+#include "identity_store.h"
 #include "license.h"
+#include "verify_cache.h"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <iostream>
+#include <random>
+#include <unordered_set>
+#include <vector>
 
 int main()
 {
@@ -14,6 +21,142 @@ int main()
     assert(! license::verifyLicense(license, "A", last, email));
     assert(! license::verifyLicense("INVALID", first, last, email));
 
+    // A signer cached after the identity prefix agrees with the one-shot path.
+    const license::IdentitySigner signer(" ada ", "LOVELACE", email);
+    assert(signer.makeLicense(license::currentDate()) == license);
+    assert(signer.verifyLicense(license));
+    assert(license::verifyLicense(signer.makeLicense("20300101"), first, last, email));
+
+    // Packed keys round-trip through text and verify without it.
+    license::PackedLicense packed;
+    assert(license::PackedLicense::parse(license, packed));
+    assert(packed.toString() == license);
+    assert(signer.verifyLicense(packed));
+    assert(signer.makePacked(packed.dateText()) == packed);
+
+    // Packed parsing accepts exactly what the text path does: a key pasted
+    // with inner whitespace, and any eight date digits.
+    const std::string wrapped = license.substr(0, 7) + "\r\n  " + license.substr(7, 10) + " " + license.substr(17);
+    assert(license::PackedLicense::parse(wrapped, packed) && packed.toString() == license);
+    assert(signer.verifyLicense(wrapped) && signer.verifyLicense(packed));
+    assert(license::PackedLicense::parse("V1-20250230-AAAA-AAAA-AAAA", packed) && packed.dateText() == "20250230");
+    assert(license::PackedLicense::parse("v1-00000000-aaaa-aaaa-2345", packed) && packed.toString() == "V1-00000000-AAAA-AAAA-2345");
+    assert(! license::PackedLicense::parse("V1-2025023X-AAAA-AAAA-AAAA", packed) && ! packed.isValid());
+    assert(! license::PackedLicense::parse("V0-20250230-AAAA-AAAA-AAAA", packed));
+    assert(license::PackedLicense::parse(license, packed));
+
+    // Whitespace and case don't matter; a misplaced separator does.
+    std::string typed = " " + license.substr(0, 12) + " " + license.substr(12) + "\n";
+    for (auto& c : typed)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    assert(license::verifyLicense(typed, first, last, email));
+    assert(! license::verifyLicense(license.substr(0, 16) + license.substr(17, 1) + "-" + license.substr(18), first, last, email));
+
+    // V1 is issued by default and V2 on request; both verify, and a key
+    // relabelled with the other scheme does not.
+    const auto v2 = license::SigningKey::builtIn().makeLicense(first, last, email, "20300101", license::Scheme::v2);
+    assert(license.rfind("V1-", 0) == 0 && v2.rfind("V2-", 0) == 0);
+    assert(license::verifyLicense(v2, first, last, email));
+    assert(signer.verifyLicense(v2));
+    assert(! license::verifyLicense("V1" + v2.substr(2), first, last, email));
+    assert(! license::verifyLicense("V2" + license.substr(2), first, last, email));
+    assert(signer.verifyLicense(signer.makePacked(packed.dateText(), license::Scheme::v2)));
+
+    // A signer prepared for one scheme still signs the other, the slow way.
+    const license::IdentitySigner v1Only("Ada", "Lovelace", email, { license::Scheme::v1 });
+    assert(v1Only.makeLicense("20300101", license::Scheme::v2) == signer.makeLicense("20300101", license::Scheme::v2));
+    assert(v1Only.makeLicense("20300101") == signer.makeLicense("20300101"));
+    assert(v1Only.verifyLicense(v2));
+    license::Scheme scheme = license::Scheme::v1;
+    assert(license::schemeFromName(" V2", scheme) && scheme == license::Scheme::v2);
+    assert(! license::schemeFromName("v3", scheme));
+
+    // Radix sort agrees with std::sort on operator<, across every digit:
+    // both versions, dates in different 16-bit halves, and signatures that
+    // differ only in their low or only in their high bits, duplicates included.
+    std::vector<license::PackedLicense> keys;
+    for (const auto* date : { "20300101", "20300102", "19991231", "20300101" })
+        for (const auto s : { license::Scheme::v1, license::Scheme::v2 })
+            keys.push_back(signer.makePacked(date, s));
+    for (uint64_t i = 0; i < 200; ++i)
+    {
+        license::PackedLicense k = keys[i % keys.size()];
+        k.signature ^= (i % 3 == 0) ? i : (i << 44);
+        keys.push_back(k);
+    }
+    std::mt19937 rng(20300101);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    auto bySort = keys;
+    std::sort(bySort.begin(), bySort.end());
+    license::radixSort(keys);
+    assert(keys == bySort);
+    assert(std::is_sorted(keys.begin(), keys.end()));
+
+    // Equal keys hash equally however they were spelled, so a hashed set dedupes them.
+    license::PackedLicense upper, lower;
+    assert(license::PackedLicense::parse(license, upper));
+    assert(license::PackedLicense::parse(" " + typed, lower));
+    assert(upper == lower && ! (upper < lower) && ! (lower < upper));
+    assert(std::hash<license::PackedLicense>{}(upper) == std::hash<license::PackedLicense>{}(lower));
+    const std::unordered_set<license::PackedLicense> distinctKeys(bySort.begin(), bySort.end());
+    assert(distinctKeys.size() == static_cast<size_t>(std::unique(bySort.begin(), bySort.end()) - bySort.begin()));
+    assert(std::unordered_set<license::PackedLicense>({ upper, lower }).size() == 1);
+
+    license::VerificationCache cache(16);
+    assert(cache.verify(license::SigningKey::builtIn(), license, first, last, email));
+    assert(cache.verify(license::SigningKey::builtIn(), license, " ADA", last, email));
+    assert(! cache.verify(license::SigningKey::builtIn(), license, "A", last, email));
+    license::VerificationCache::invalidateAll();
+    assert(cache.verify(license::SigningKey::builtIn(), license, first, last, email));
+
+    // RFC 4231 test case 2, through a clone taken mid-message.
+    const std::string key = "Jefe";
+    const std::string message = "what do ya want for nothing?";
+    crypto_small::HmacSha256 mac(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+    mac.update(reinterpret_cast<const uint8_t*>(message.data()), 10);
+    auto tail = mac.clone();
+    tail.update(reinterpret_cast<const uint8_t*>(message.data()) + 10, message.size() - 10);
+    const auto digest = tail.digest();
+    assert(digest[0] == 0x5b && digest[1] == 0xdc && digest[30] == 0x38 && digest[31] == 0x43);
+
+    // RFC 7693 appendix B, then keyed BLAKE2s from the reference KAT
+    // (key 00..1f, message 00..3f) split across a clone.
+    crypto_small::Blake2sMac plain(nullptr, 0);
+    plain.update(reinterpret_cast<const uint8_t*>("abc"), 3);
+    const auto abc = plain.digest();
+    assert(abc[0] == 0x50 && abc[1] == 0x8c && abc[30] == 0x59 && abc[31] == 0x82);
+
+    uint8_t kat[64];
+    for (uint8_t i = 0; i < 64; ++i)
+        kat[i] = i;
+    crypto_small::Blake2sMac keyed(kat, 32);
+    keyed.update(kat, 20);
+    auto rest = keyed.clone();
+    rest.update(kat + 20, 44);
+    const auto b2 = rest.digest();
+    assert(b2[0] == 0x89 && b2[1] == 0x75 && b2[30] == 0x4e && b2[31] == 0xd4);
+
+    // Identity store: normalised, deduplicated, and every stored identity
+    // found again at the position at() reports, across block boundaries.
+    identities::IdentityStore::Builder builder;
+    for (int i = 0; i < 100; ++i)
+        builder.add("Ann", "Lee " + std::to_string(i % 7), "user" + std::to_string(i) + "@Example.com");
+    builder.add("  ann ", "LEE   0", "USER0@example.com");
+    builder.add("Bob", "Smith", "no-domain");
+    const auto store = builder.build();
+    assert(store.size() == 101);
+    for (size_t i = 0; i < store.size(); ++i)
+    {
+        const auto id = store.at(i);
+        size_t found = store.size();
+        assert(store.find(id.first, id.last, id.email, found) && found == i);
+    }
+    size_t slot = 0;
+    assert(store.find("ANN", "lee 3", "User10@example.COM", slot) && store.at(slot).email == "user10@example.com");
+    assert(store.find("bob", "smith", "No-Domain", slot));
+    assert(! store.find("Ann", "Lee 3", "user11@example.com", slot));
+    assert(! store.find("Ann", "Lee 1", "user1@example.org", slot));
+
     std::cout << "All license tests passed\n";
     return 0;
 }
@@ -0,0 +1,97 @@
+#if defined(RUN_REPLICATION_TESTS)
+#include <JuceHeader.h>
+#include "batch.h"
+#include "replication.h"
+#include <cassert>
+#include <iostream>
+
+namespace
+{
+    void addRecord(const juce::File& station, const juce::String& first)
+    {
+        const bool ok = batch::appendLicenseRecord(batch::defaultLedgerFile(station), first, "Tester",
+                                                   first.toLowerCase() + "@example.com", "V1-20300101-AAAA-AAAA-AAAA");
+        assert(ok);
+        juce::ignoreUnused(ok);
+    }
+
+    // (station, seq, first) of every record in a global ledger.
+    juce::StringArray globalRecords(const juce::File& global)
+    {
+        juce::StringArray lines, records;
+        global.readLines(lines);
+        for (int i = 1; i < lines.size(); ++i)
+        {
+            const auto fields = batch::splitCsvLine(lines[i]);
+            if (fields.size() >= 3)
+                records.add(fields[0] + " " + fields[1] + " " + fields[2]);
+        }
+        return records;
+    }
+}
+
+int main()
+{
+    const auto root = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                          .getChildFile("smk-replication-" + juce::Uuid().toString());
+    const auto a = root.getChildFile("a");
+    const auto b = root.getChildFile("b");
+    const auto global = root.getChildFile("global.csv");
+    const juce::Array<juce::File> peers { a, b };
+
+    const bool created = a.createDirectory().wasOk() && b.createDirectory().wasOk();
+    assert(created);
+
+    const auto idA = replication::stationId(a);
+    const auto idB = replication::stationId(b);
+
+    // Publish from two stations, sync both.
+    addRecord(a, "Ann");
+    addRecord(a, "Amy");
+    addRecord(b, "Bob");
+
+    replication::PublishSummary fromA, fromB;
+    const auto publishedA = replication::publish(a, fromA);
+    const auto publishedB = replication::publish(b, fromB);
+    assert(publishedA.wasOk() && fromA.records == 2);
+    assert(publishedB.wasOk() && fromB.records == 1);
+
+    replication::SyncSummary first;
+    const auto synced = replication::sync(global, peers, first);
+    assert(synced.wasOk() && first.records == 3);
+    assert(globalRecords(global) == juce::StringArray({ idA + " 1 Ann", idA + " 2 Amy", idB + " 1 Bob" }));
+
+    // Publish again: only the new record ships, and its seq carries on.
+    addRecord(a, "Abe");
+    replication::PublishSummary again;
+    const auto republished = replication::publish(a, again);
+    assert(republished.wasOk() && again.records == 1 && again.segments == 1);
+
+    replication::SyncSummary second;
+    const auto resynced = replication::sync(global, peers, second);
+    assert(resynced.wasOk() && second.records == 1);
+    const juce::StringArray expected { idA + " 1 Ann", idA + " 2 Amy", idB + " 1 Bob", idA + " 3 Abe" };
+    assert(globalRecords(global) == expected);
+
+    // A sync that died after appending is rolled back, not applied twice.
+    global.appendText(idA + ",4,Half,Written,", false, false);
+    replication::SyncSummary nothing;
+    const auto rolledBack = replication::sync(global, peers, nothing);
+    assert(rolledBack.wasOk() && nothing.records == 0);
+    assert(globalRecords(global) == expected);
+
+    // A non-empty global ledger without its state file is left alone.
+    const auto before = global.loadFileAsString();
+    global.getSiblingFile(global.getFileName() + ".sync").deleteFile();
+    replication::SyncSummary refused;
+    const auto withoutState = replication::sync(global, peers, refused);
+    assert(withoutState.failed());
+    assert(global.loadFileAsString() == before);
+
+    root.deleteRecursively();
+    juce::ignoreUnused(created, publishedA, publishedB, synced, republished, resynced, rolledBack, withoutState);
+
+    std::cout << "All replication tests passed\n";
+    return 0;
+}
+#endif
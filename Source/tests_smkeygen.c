@@ -0,0 +1,68 @@
+#if defined(RUN_SMKEYGEN_TESTS)
+/* Plain C, so it also checks that smkeygen.h stays usable from C. */
+#undef NDEBUG /* the checks are asserts, so keep them in Release builds */
+#include "smkeygen.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static smk_field field(const char* text)
+{
+    smk_field f;
+    f.data = text;
+    f.size = strlen(text);
+    return f;
+}
+
+static void today(char out[9])
+{
+    const time_t now = time(NULL);
+    strftime(out, 9, "%Y%m%d", gmtime(&now));
+}
+
+int main(void)
+{
+    smk_context* context = NULL;
+    char key[SMK_LICENSE_LENGTH];
+    char dated[SMK_LICENSE_LENGTH];
+    char before[9];
+    char after[9];
+    int valid = 0;
+
+    assert(smk_abi_version() == SMK_ABI_VERSION);
+    assert(smk_context_new(NULL, 0, &context) == SMK_OK && context != NULL);
+
+    /* A fixed date is used as given, and the key verifies. */
+    assert(smk_issue(context, field("Ada"), field("Lovelace"), field("ada@example.com"), "20300101", dated) == SMK_OK);
+    assert(memcmp(dated, "V1-20300101-", 12) == 0);
+    {
+        smk_field license;
+        license.data = dated;
+        license.size = SMK_LICENSE_LENGTH;
+        assert(smk_verify(context, license, field("Ada"), field("Lovelace"), field("ada@example.com"), &valid) == SMK_OK);
+        assert(valid == 1);
+        assert(smk_verify(context, license, field("Ada"), field("Byron"), field("ada@example.com"), &valid) == SMK_OK);
+        assert(valid == 0);
+    }
+
+    /* Null and "" both mean today; either day counts if the check straddles UTC midnight. */
+    today(before);
+    assert(smk_issue(context, field("Ada"), field("Lovelace"), field("ada@example.com"), NULL, key) == SMK_OK);
+    assert(smk_issue(context, field("Ada"), field("Lovelace"), field("ada@example.com"), "", dated) == SMK_OK);
+    today(after);
+    assert(memcmp(key + 3, before, 8) == 0 || memcmp(key + 3, after, 8) == 0);
+    assert(memcmp(dated + 3, before, 8) == 0 || memcmp(dated + 3, after, 8) == 0);
+
+    /* Anything else must be a real date. */
+    assert(smk_issue(context, field("Ada"), field("Lovelace"), field("ada@example.com"), "2030", key) == SMK_INVALID_ARGUMENT);
+    assert(smk_issue(context, field("Ada"), field("Lovelace"), field("ada@example.com"), "20300230", key) == SMK_INVALID_ARGUMENT);
+    assert(smk_issue(NULL, field("Ada"), field("Lovelace"), field("ada@example.com"), NULL, key) == SMK_INVALID_ARGUMENT);
+
+    smk_context_free(context);
+    (void) valid;
+
+    puts("All smkeygen tests passed");
+    return 0;
+}
+#endif
@@ -0,0 +1,173 @@
+#include "trace.h"
+
+#if SMK_ENABLE_TRACING
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+    namespace
+    {
+        constexpr size_t kRingSize = size_t(1) << 16;
+
+        struct Event
+        {
+            const char* name = nullptr;
+            uint64_t start = 0;
+            uint64_t end = 0;
+        };
+
+        struct ThreadBuffer
+        {
+            uint32_t tid = 0;
+            std::string threadName;
+            std::array<Event, kRingSize> events{};
+            std::atomic<uint64_t> head{ 0 };
+        };
+
+        // Buffers outlive their threads so spans from finished workers still
+        // export. A thread that exits hands its buffer to the free list and the
+        // next new thread records into it, so there are only ever as many
+        // buffers as threads were alive at once. Never destroyed, so threads
+        // that exit during static destruction can still return theirs.
+        struct Registry
+        {
+            std::mutex lock;
+            std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+            std::vector<ThreadBuffer*> free;
+        };
+
+        Registry& registry()
+        {
+            static auto* instance = new Registry();
+            return *instance;
+        }
+
+        const auto epoch = std::chrono::steady_clock::now();
+
+        struct BufferOwner
+        {
+            BufferOwner()
+            {
+                auto& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                if (! r.free.empty())
+                {
+                    // The older thread's spans stay in the ring, on the same track.
+                    buffer = r.free.back();
+                    r.free.pop_back();
+                    buffer->threadName.clear();
+                }
+                else
+                {
+                    r.buffers.push_back(std::make_unique<ThreadBuffer>());
+                    buffer = r.buffers.back().get();
+                    buffer->tid = static_cast<uint32_t>(r.buffers.size());
+                }
+            }
+
+            ~BufferOwner()
+            {
+                auto& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                r.free.push_back(buffer);
+            }
+
+            ThreadBuffer* buffer = nullptr;
+        };
+
+        ThreadBuffer& localBuffer()
+        {
+            thread_local BufferOwner owner;
+            return *owner.buffer;
+        }
+
+        void writeEscaped(std::ostream& out, const char* s)
+        {
+            for (; *s != '\0'; ++s)
+            {
+                if (*s == '"' || *s == '\\')
+                    out << '\\';
+                out << *s;
+            }
+        }
+    }
+
+    uint64_t nowNanos() noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count());
+    }
+
+    void recordSpan(const char* name, uint64_t startNanos, uint64_t endNanos) noexcept
+    {
+        auto& buffer = localBuffer();
+        const auto index = buffer.head.load(std::memory_order_relaxed);
+        auto& ev = buffer.events[index & (kRingSize - 1)];
+        ev.name = name;
+        ev.start = startNanos;
+        ev.end = endNanos;
+        buffer.head.store(index + 1, std::memory_order_release);
+    }
+
+    void setThreadName(const char* name)
+    {
+        auto& buffer = localBuffer();
+        std::lock_guard<std::mutex> lock(registry().lock);
+        buffer.threadName = name;
+    }
+
+    bool writeChromeJson(const std::string& path)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (! out)
+            return false;
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        for (const auto& buffer : r.buffers)
+        {
+            if (! buffer->threadName.empty())
+            {
+                out << (first ? "" : ",")
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                    << ",\"args\":{\"name\":\"";
+                writeEscaped(out, buffer->threadName.c_str());
+                out << "\"}}";
+                first = false;
+            }
+
+            const auto head = buffer->head.load(std::memory_order_acquire);
+            const auto begin = head > kRingSize ? head - kRingSize : 0;
+            for (auto i = begin; i < head; ++i)
+            {
+                const auto& ev = buffer->events[i & (kRingSize - 1)];
+                if (ev.name == nullptr)
+                    continue;
+
+                // Chrome expects microseconds; keep sub-microsecond precision.
+                out << (first ? "" : ",") << "{\"name\":\"";
+                writeEscaped(out, ev.name);
+                out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                    << ",\"ts\":" << static_cast<double>(ev.start) / 1000.0
+                    << ",\"dur\":" << static_cast<double>(ev.end - ev.start) / 1000.0 << '}';
+                first = false;
+            }
+        }
+
+        out << "]}\n";
+        return static_cast<bool>(out);
+    }
+} // namespace trace
+
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+    Scoped timeline tracing, exported in the Chrome trace-event JSON format
+    (open the file in chrome://tracing or ui.perfetto.dev).
+
+    Tracing is compiled out unless SMK_ENABLE_TRACING is defined to 1, e.g. in
+    the Projucer exporter's preprocessor definitions. When disabled,
+    SMK_TRACE_SCOPE expands to nothing and writeChromeJson() is a no-op.
+
+    Each thread records into its own fixed-size ring buffer, so spans cost two
+    clock reads and a few stores; the oldest spans are overwritten once a
+    thread's buffer wraps. A thread's buffer is handed to the next new thread
+    once it exits, so short-lived threads don't add a buffer each.
+*/
+
+#ifndef SMK_ENABLE_TRACING
+ #define SMK_ENABLE_TRACING 0
+#endif
+
+#include <string>
+
+#if SMK_ENABLE_TRACING
+ #include <chrono>
+ #include <cstdint>
+#endif
+
+namespace trace
+{
+#if SMK_ENABLE_TRACING
+    uint64_t nowNanos() noexcept;
+    void recordSpan(const char* name, uint64_t startNanos, uint64_t endNanos) noexcept;
+
+    // Labels the calling thread in the exported timeline.
+    void setThreadName(const char* name);
+
+    class ScopedSpan
+    {
+    public:
+        explicit ScopedSpan(const char* spanName) noexcept
+            : name(spanName), start(nowNanos())
+        {
+        }
+
+        ~ScopedSpan()
+        {
+            recordSpan(name, start, nowNanos());
+        }
+
+        ScopedSpan(const ScopedSpan&) = delete;
+        ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start;
+    };
+
+    // Writes all buffered spans. Call once worker threads are idle; spans
+    // recorded concurrently with the flush may be missing or partial.
+    bool writeChromeJson(const std::string& path);
+
+ #define SMK_TRACE_CONCAT_INNER(a, b) a##b
+ #define SMK_TRACE_CONCAT(a, b) SMK_TRACE_CONCAT_INNER(a, b)
+ #define SMK_TRACE_SCOPE(name) ::trace::ScopedSpan SMK_TRACE_CONCAT(smkTraceSpan_, __LINE__) (name)
+#else
+    inline void setThreadName(const char*) {}
+    inline bool writeChromeJson(const std::string&) { return false; }
+
+ #define SMK_TRACE_SCOPE(name) ((void) 0)
+#endif
+} // namespace trace
@@ -0,0 +1,134 @@
+#include "verify_cache.h"
+#include "metrics.h"
+
+namespace license
+{
+    namespace
+    {
+        std::atomic<uint64_t> generation { 1 };
+
+        // FNV-1a over each field, with a separator so ("ab","c") != ("a","bc").
+        uint64_t hashOf(uint64_t keyId, const std::string& licenseStr, const std::string& identity) noexcept
+        {
+            uint64_t h = 1469598103934665603ull ^ keyId;
+            auto mix = [&h](const std::string& s)
+            {
+                for (const unsigned char c : s)
+                {
+                    h ^= c;
+                    h *= 1099511628211ull;
+                }
+                h ^= 0xff;
+                h *= 1099511628211ull;
+            };
+            mix(licenseStr);
+            mix(identity);
+
+            // Spread the high bits down so the shard index sees all of them.
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            return h;
+        }
+    }
+
+    VerificationCache::VerificationCache(size_t capacity)
+        : perShard(capacity / kShards > 0 ? capacity / kShards : 1)
+    {
+    }
+
+    void VerificationCache::invalidateAll() noexcept
+    {
+        generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    bool VerificationCache::verify(const SigningKey& key,
+                                   const std::string& licenseStr,
+                                   const std::string& first,
+                                   const std::string& last,
+                                   const std::string& email)
+    {
+        const auto identity = identityOf(first, last, email);
+        const auto hash = hashOf(key.id(), licenseStr, identity);
+        const auto gen = generation.load(std::memory_order_acquire);
+        auto& shard = shards[hash % kShards];
+
+        {
+            std::lock_guard<std::mutex> hold(shard.lock);
+            const auto it = shard.slots.find(hash);
+            if (it != shard.slots.end())
+            {
+                auto& e = shard.entries[it->second];
+                if (e.generation == gen && e.keyId == key.id()
+                    && e.licenseStr == licenseStr && e.identity == identity)
+                {
+                    e.referenced = true;
+                    metrics::addCacheLookup(true);
+                    return e.valid;
+                }
+            }
+        }
+
+        metrics::addCacheLookup(false);
+
+        // Verify outside the lock; two threads missing on the same key both
+        // verify and the second store just overwrites the first.
+        Entry entry;
+        entry.valid = key.verifyLicense(licenseStr, first, last, email);
+        entry.hash = hash;
+        entry.generation = gen;
+        entry.keyId = key.id();
+        entry.licenseStr = licenseStr;
+        entry.identity = identity;
+
+        const bool valid = entry.valid;
+        std::lock_guard<std::mutex> hold(shard.lock);
+        store(shard, std::move(entry));
+        return valid;
+    }
+
+    void VerificationCache::store(Shard& shard, Entry entry)
+    {
+        const auto it = shard.slots.find(entry.hash);
+        if (it != shard.slots.end())
+        {
+            shard.entries[it->second] = std::move(entry);
+            return;
+        }
+
+        if (shard.entries.size() < perShard)
+        {
+            shard.slots.emplace(entry.hash, shard.entries.size());
+            shard.entries.push_back(std::move(entry));
+            return;
+        }
+
+        // CLOCK: clear reference bits until an unreferenced (or stale) entry turns up.
+        const auto gen = generation.load(std::memory_order_acquire);
+        for (;;)
+        {
+            auto& victim = shard.entries[shard.hand];
+            if (victim.referenced && victim.generation == gen)
+            {
+                victim.referenced = false;
+                shard.hand = (shard.hand + 1) % shard.entries.size();
+                continue;
+            }
+
+            shard.slots.erase(victim.hash);
+            shard.slots.emplace(entry.hash, shard.hand);
+            victim = std::move(entry);
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+            return;
+        }
+    }
+
+    bool verifyLicenseCached(const std::string& licenseStr,
+                             const std::string& first,
+                             const std::string& last,
+                             const std::string& email)
+    {
+        static VerificationCache cache;
+        return cache.verify(SigningKey::builtIn(), licenseStr, first, last, email);
+    }
+} // namespace license
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "license.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Verification results, remembered.
+
+    The same keys are verified again and again (the resident instance, the
+    embedding ABI, an operator re-checking a customer), and each verify costs
+    two SHA-256 compressions at least. VerificationCache keeps the answer,
+    keyed by a hash of the raw license, the normalised identity and the
+    signing key, in 16 independently locked shards that evict by CLOCK.
+    A hit still compares the full strings, so a hash collision can only cost
+    a miss, never a wrong answer.
+
+    invalidateAll() bumps a process-wide generation that makes every cached
+    answer stale at once; call it whenever a key stops being trusted.
+*/
+namespace license
+{
+    class VerificationCache
+    {
+    public:
+        explicit VerificationCache(size_t capacity = 65536);
+
+        bool verify(const SigningKey& key,
+                    const std::string& licenseStr,
+                    const std::string& first,
+                    const std::string& last,
+                    const std::string& email);
+
+        static void invalidateAll() noexcept;
+
+    private:
+        struct Entry
+        {
+            uint64_t hash = 0;
+            uint64_t generation = 0;
+            uint64_t keyId = 0;
+            std::string licenseStr;
+            std::string identity;
+            bool valid = false;
+            bool referenced = false;
+        };
+
+        struct Shard
+        {
+            std::mutex lock;
+            std::unordered_map<uint64_t, size_t> slots;
+            std::vector<Entry> entries;
+            size_t hand = 0;
+        };
+
+        static constexpr size_t kShards = 16;
+
+        void store(Shard& shard, Entry entry);
+
+        size_t perShard;
+        std::array<Shard, kShards> shards;
+    };
+
+    // Verifies against the built-in key through one process-wide cache.
+    bool verifyLicenseCached(const std::string& licenseStr,
+                             const std::string& first,
+                             const std::string& last,
+                             const std::string& email);
+} // namespace license
@@ -0,0 +1,116 @@
+#include "watchdog.h"
+
+namespace watchdog
+{
+    namespace
+    {
+        constexpr int kHeartbeatMs = 20;
+        constexpr int kPollMs = 5;
+        constexpr juce::int64 kMaxLogBytes = 1024 * 1024;
+        constexpr int kKeptLogs = 3;
+
+        // Only ever written on the message thread; read by the watchdog.
+        std::atomic<const char*> currentOperation { nullptr };
+
+        // stalls.log -> stalls.log.1 -> ... -> stalls.log.<kKeptLogs>, dropping the oldest.
+        void rotate(const juce::File& log)
+        {
+            if (log.getSize() < kMaxLogBytes)
+                return;
+
+            auto numbered = [&log](int n) { return log.getSiblingFile(log.getFileName() + "." + juce::String(n)); };
+
+            numbered(kKeptLogs).deleteFile();
+            for (int n = kKeptLogs - 1; n >= 1; --n)
+                numbered(n).moveFileTo(numbered(n + 1));
+            log.moveFileTo(numbered(1));
+        }
+    }
+
+    ScopedOperation::ScopedOperation(const char* tag) noexcept
+        : previous(currentOperation.exchange(tag, std::memory_order_relaxed))
+    {
+        JUCE_ASSERT_MESSAGE_THREAD
+    }
+
+    ScopedOperation::~ScopedOperation()
+    {
+        currentOperation.store(previous, std::memory_order_relaxed);
+    }
+
+    Watchdog::Watchdog(const juce::File& file, int threshold)
+        : juce::Thread("Message thread watchdog"),
+          logFile(file),
+          thresholdMs(threshold)
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    Watchdog::~Watchdog()
+    {
+        *alive = false;
+        stopThread(2000);
+    }
+
+    void Watchdog::run()
+    {
+        for (uint64_t seq = 1; ! threadShouldExit(); ++seq)
+        {
+            const double sentAtMs = juce::Time::getMillisecondCounterHiRes();
+            const auto sentAt = juce::Time::getCurrentTime();
+
+            juce::MessageManager::callAsync([beat = heartbeat, seq]
+            {
+                beat->answeredAtMs = juce::Time::getMillisecondCounterHiRes();
+                beat->answered = seq;
+            });
+
+            const char* operation = nullptr;
+            bool stalled = false;
+            while (heartbeat->answered.load() < seq)
+            {
+                if (threadShouldExit())
+                    return;
+
+                wait(kPollMs);
+
+                // The tag open when the threshold passed is the culprit; if
+                // nothing was tagged yet, take the first one that shows up.
+                if (juce::Time::getMillisecondCounterHiRes() - sentAtMs >= thresholdMs)
+                {
+                    stalled = true;
+                    if (operation == nullptr)
+                        operation = currentOperation.load(std::memory_order_relaxed);
+                }
+            }
+
+            if (stalled)
+            {
+                Stall stall;
+                stall.operation = operation != nullptr ? juce::String(operation) : juce::String("untagged");
+                stall.milliseconds = heartbeat->answeredAtMs.load() - sentAtMs;
+                stall.started = sentAt;
+                report(stall);
+            }
+
+            wait(kHeartbeatMs);
+        }
+    }
+
+    void Watchdog::report(const Stall& stall)
+    {
+        rotate(logFile);
+
+        juce::String line;
+        line << stall.started.toISO8601(true) << "  "
+             << juce::String(stall.milliseconds, 1) << " ms  "
+             << stall.operation << "\n";
+        logFile.appendText(line, false, false, "\n");
+
+        juce::MessageManager::callAsync([this, stall, stillAlive = alive]
+        {
+            if (*stillAlive && onStall != nullptr)
+                onStall(stall);
+        });
+    }
+} // namespace watchdog
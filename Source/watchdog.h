@@ -0,0 +1,67 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/*
+    Message-thread stall detection.
+
+    Watchdog posts a heartbeat to the message thread every 20 ms from its own
+    thread. A heartbeat that takes longer than the threshold to be answered
+    means some callback held the message thread that long. Once the stall is
+    over, it is appended to a log file and handed to onStall, together with
+    the innermost ScopedOperation that was open while it lasted.
+
+    Log files rotate at 1 MB, keeping stalls.log.1 .. .3.
+*/
+namespace watchdog
+{
+    // Tags what the message thread is doing while it is in scope, e.g.
+    // "CSV load". Tags nest, and tag must outlive the scope (a literal).
+    class ScopedOperation
+    {
+    public:
+        explicit ScopedOperation(const char* tag) noexcept;
+        ~ScopedOperation();
+
+        ScopedOperation(const ScopedOperation&) = delete;
+        ScopedOperation& operator=(const ScopedOperation&) = delete;
+
+    private:
+        const char* previous;
+    };
+
+    struct Stall
+    {
+        juce::String operation;   // "untagged" when no ScopedOperation was open
+        double milliseconds = 0.0;
+        juce::Time started;
+    };
+
+    class Watchdog : private juce::Thread
+    {
+    public:
+        explicit Watchdog(const juce::File& logFile, int thresholdMs = 50);
+        ~Watchdog() override;
+
+        // Called on the message thread after each stall has ended.
+        std::function<void(const Stall&)> onStall;
+
+    private:
+        struct Heartbeat
+        {
+            std::atomic<uint64_t> answered { 0 };
+            std::atomic<double> answeredAtMs { 0.0 };
+        };
+
+        void run() override;
+        void report(const Stall& stall);
+
+        const juce::File logFile;
+        const int thresholdMs;
+        std::shared_ptr<Heartbeat> heartbeat = std::make_shared<Heartbeat>();
+        std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+    };
+} // namespace watchdog
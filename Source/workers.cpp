@@ -0,0 +1,284 @@
+#include "workers.h"
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace workers
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        constexpr auto kSliceTarget = std::chrono::microseconds(1000);
+
+        struct Job
+        {
+            std::function<void()> run;
+            Clock::time_point queuedAt;
+            bool sliced = false;
+        };
+
+        thread_local bool onWorkerThread = false;
+
+        class Scheduler
+        {
+        public:
+            explicit Scheduler(size_t threads)
+            {
+                for (size_t i = 0; i < threads; ++i)
+                    workerThreads.emplace_back([this] { workerLoop(); });
+            }
+
+            ~Scheduler()
+            {
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    stopping = true;
+                    interactive.clear();
+                    bulk.clear();
+                    publishDepths();
+                }
+                wake.notify_all();
+
+                for (auto& t : workerThreads)
+                    t.join();
+            }
+
+            size_t size() const noexcept { return workerThreads.size(); }
+
+            void submit(Priority priority, std::function<void()> run, bool sliced)
+            {
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    if (stopping)
+                        return;
+
+                    auto& queue = priority == Priority::interactive ? interactive : bulk;
+                    queue.push_back({ std::move(run), Clock::now(), sliced });
+                    publishDepths();
+                }
+                wake.notify_one();
+            }
+
+            // Runs one queued interactive job on the calling thread, if there is one.
+            bool runInteractive()
+            {
+                Job job;
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    if (interactive.empty())
+                        return false;
+
+                    job = std::move(interactive.front());
+                    interactive.pop_front();
+                    publishDepths();
+                }
+
+                execute(job, metrics::Stage::queueInteractive);
+                return true;
+            }
+
+        private:
+            // An unsliced bulk job may hold a worker for a long time, so one
+            // worker is always left for interactive jobs.
+            bool canTake(const Job& job) const noexcept
+            {
+                return job.sliced || workerThreads.size() < 2 || unslicedRunning + 1 < workerThreads.size();
+            }
+
+            bool takeNext(Job& out, metrics::Stage& stage)
+            {
+                if (! interactive.empty())
+                {
+                    out = std::move(interactive.front());
+                    interactive.pop_front();
+                    stage = metrics::Stage::queueInteractive;
+                    return true;
+                }
+
+                for (auto it = bulk.begin(); it != bulk.end(); ++it)
+                {
+                    if (canTake(*it))
+                    {
+                        out = std::move(*it);
+                        bulk.erase(it);
+                        stage = metrics::Stage::queueBulk;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void workerLoop()
+            {
+                onWorkerThread = true;
+
+                for (;;)
+                {
+                    Job job;
+                    auto stage = metrics::Stage::queueBulk;
+                    {
+                        std::unique_lock<std::mutex> hold(lock);
+                        wake.wait(hold, [&] { return stopping || takeNext(job, stage); });
+                        if (stopping)
+                            return;
+
+                        if (! job.sliced && stage == metrics::Stage::queueBulk)
+                            ++unslicedRunning;
+                        publishDepths();
+                    }
+
+                    execute(job, stage);
+
+                    if (! job.sliced && stage == metrics::Stage::queueBulk)
+                    {
+                        {
+                            std::lock_guard<std::mutex> hold(lock);
+                            --unslicedRunning;
+                        }
+                        wake.notify_one();
+                    }
+                }
+            }
+
+            static void execute(Job& job, metrics::Stage stage)
+            {
+                const auto waited = Clock::now() - job.queuedAt;
+                metrics::record(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()));
+                job.run();
+            }
+
+            void publishDepths() noexcept
+            {
+                metrics::setQueueDepths(interactive.size(), bulk.size());
+            }
+
+            std::mutex lock;
+            std::condition_variable wake;
+            std::deque<Job> interactive;
+            std::deque<Job> bulk;
+            size_t unslicedRunning = 0;
+            bool stopping = false;
+            std::vector<std::thread> workerThreads;
+        };
+
+        std::mutex schedulerLock;
+        std::unique_ptr<Scheduler> sharedScheduler;
+
+        Scheduler& scheduler()
+        {
+            std::lock_guard<std::mutex> hold(schedulerLock);
+            if (sharedScheduler == nullptr)
+                sharedScheduler = std::make_unique<Scheduler>(static_cast<size_t>(juce::jmax(1, juce::SystemStats::getNumCpus())));
+            return *sharedScheduler;
+        }
+
+        // One parallelFor call. Slices are claimed from `next`; each one sizes
+        // itself from the last so it takes about kSliceTarget.
+        struct Loop
+        {
+            const std::function<void(size_t, size_t)>* body = nullptr;
+            size_t count = 0;
+            std::atomic<size_t> next { 0 };
+            std::atomic<size_t> grain { 4 };
+
+            std::mutex lock;
+            std::condition_variable finishedAll;
+            size_t finished = 0;
+
+            // Returns false once there is nothing left to claim.
+            bool runSlice()
+            {
+                const size_t size = grain.load(std::memory_order_relaxed);
+                const size_t begin = next.fetch_add(size);
+                if (begin >= count)
+                    return false;
+
+                const size_t end = juce::jmin(count, begin + size);
+                const auto start = Clock::now();
+                (*body)(begin, end);
+                const auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+                // Aim the next slice at the target, changing by at most 4x at a time.
+                const auto target = std::chrono::duration_cast<std::chrono::nanoseconds>(kSliceTarget).count();
+                const double perItem = static_cast<double>(juce::jmax<long long>(1, took)) / static_cast<double>(end - begin);
+                const auto wanted = static_cast<size_t>(static_cast<double>(target) / perItem);
+                grain.store(juce::jlimit<size_t>(juce::jmax<size_t>(1, size / 4), size * 4, juce::jmax<size_t>(1, wanted)),
+                            std::memory_order_relaxed);
+
+                bool all = false;
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    finished += end - begin;
+                    all = finished == count;
+                }
+                if (all)
+                    finishedAll.notify_all();
+                return true;
+            }
+        };
+
+        // A worker's share of a loop: one slice, then back in the bulk queue
+        // so interactive jobs queued meanwhile run first.
+        void scheduleSlice(Scheduler& s, std::shared_ptr<Loop> loop)
+        {
+            s.submit(Priority::bulk, [&s, loop]
+            {
+                if (loop->runSlice())
+                    scheduleSlice(s, loop);
+            }, true);
+        }
+    }
+
+    void submit(Priority priority, std::function<void()> job)
+    {
+        scheduler().submit(priority, std::move(job), false);
+    }
+
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body)
+    {
+        if (count == 0)
+            return;
+
+        auto& s = scheduler();
+        auto loop = std::make_shared<Loop>();
+        loop->body = &body;
+        loop->count = count;
+
+        const size_t helpers = juce::jmin(s.size(), count) - (s.size() > 1 ? 1 : 0);
+        for (size_t i = 0; i < helpers; ++i)
+            scheduleSlice(s, loop);
+
+        // The caller works too; on a worker it also lets interactive jobs through between slices.
+        while (loop->runSlice())
+            if (onWorkerThread)
+                s.runInteractive();
+
+        std::unique_lock<std::mutex> hold(loop->lock);
+        loop->finishedAll.wait(hold, [&] { return loop->finished == loop->count; });
+    }
+
+    size_t numWorkers()
+    {
+        return scheduler().size();
+    }
+
+    void shutdown()
+    {
+        // Destroyed outside the lock: its destructor joins the workers, and a
+        // job still running may call scheduler() (through parallelFor) first.
+        std::unique_ptr<Scheduler> stopping;
+        {
+            std::lock_guard<std::mutex> hold(schedulerLock);
+            stopping = std::move(sharedScheduler);
+        }
+        stopping = nullptr;
+    }
+} // namespace workers
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstddef>
+#include <functional>
+
+/*
+    Process-wide job scheduler for background work, started on first use with
+    one worker thread per CPU. Call shutdown() from the application's
+    shutdown() so the threads stop before JUCE itself is torn down.
+
+    Jobs come in two classes. Workers always take a queued interactive job
+    (a Generate press, a verify, a search query) before any bulk one, and
+    bulk row work goes through parallelFor(), which cuts it into slices of
+    about a millisecond that requeue behind interactive work. So an
+    interactive job waits for at most one slice while bulk work still keeps
+    every core busy. Plain bulk jobs (a whole file, say) cannot be sliced,
+    so at most all-but-one workers run them at a time.
+
+    Queue depths and per-class wait times appear in the metrics.
+*/
+namespace workers
+{
+    enum class Priority
+    {
+        interactive,
+        bulk
+    };
+
+    void submit(Priority priority, std::function<void()> job);
+
+    // Calls body(begin, end) over [0, count) in slices across the workers
+    // and the calling thread, and returns once every slice is done.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body);
+
+    size_t numWorkers();
+
+    void shutdown();
+} // namespace workers